@@ -0,0 +1,573 @@
+#include "AmrFluidsim.h"
+#include <cmath>
+#include <algorithm>
+
+AmrFluidsim::AmrFluidsim(int rootsX, int rootsY, int maxLevel) {
+	// at least one root each way
+	this->maxLevel = std::max(maxLevel, 0);
+	this->rootsX = std::max(rootsX, 1);
+	this->rootsY = std::max(rootsY, 1);
+	this->Nx = this->rootsX * (B << this->maxLevel);
+	this->Ny = this->rootsY * (B << this->maxLevel);
+	this->hFine = 1.0f / std::max(this->Nx, this->Ny);
+
+	this->dt = 0.1f;
+	this->diff = 0.0f;
+	this->visc = 0.0f;
+
+	this->criteria.vorticity = 0.02f;
+	this->criteria.densityGradient = 0.5f;
+	this->criteria.coarsenFraction = 0.25f;
+
+	nodes.resize((size_t)rootsX * rootsY);
+	for (int j = 0; j < rootsY; j++) {
+		for (int i = 0; i < rootsX; i++) {
+			Node& n = nodes[i + j * rootsX];
+			n.level = 0;
+			n.ix = i;
+			n.iy = j;
+			n.child = -1;
+			n.data.assign(CHANNELS * BLOCK_CELLS, 0.0f);
+		}
+	}
+	rebuildLeaves();
+}
+
+// X, Y are in units of finest cells, measured from the domain corner.
+int AmrFluidsim::findLeaf(float X, float Y) const {
+	int rootSize = B << maxLevel;
+	int rx = std::min(std::max((int)(X / rootSize), 0), rootsX - 1);
+	int ry = std::min(std::max((int)(Y / rootSize), 0), rootsY - 1);
+	int node = rx + ry * rootsX;
+	while (nodes[node].child >= 0) {
+		const Node& n = nodes[node];
+		float half = 0.5f * B * scale(n.level);
+		int qx = X >= (2 * n.ix + 1) * half;
+		int qy = Y >= (2 * n.iy + 1) * half;
+		node = n.child + qx + 2 * qy;
+	}
+	return node;
+}
+
+// Cell holding point (X, Y); points beyond a wall map to the edge cell, as the
+// ghost ring of set_bnd copies its inner neighbour.
+void AmrFluidsim::locate(float X, float Y, int& node, int& cell, int& wall) const {
+	wall = 0;
+	if (X < 0.0f) { X = 0.0f; wall |= 1; }
+	if (X >= Nx) { X = Nx - 0.5f; wall |= 1; }
+	if (Y < 0.0f) { Y = 0.0f; wall |= 2; }
+	if (Y >= Ny) { Y = Ny - 0.5f; wall |= 2; }
+
+	node = findLeaf(X, Y);
+	const Node& n = nodes[node];
+	int s = scale(n.level);
+	int i = std::min((int)(X / s) - n.ix * B, B - 1);
+	int j = std::min((int)(Y / s) - n.iy * B, B - 1);
+	cell = i + j * B;
+}
+
+float AmrFluidsim::cellValue(int c, float X, float Y, int b) const {
+	int node, cell, wall;
+	locate(X, Y, node, cell, wall);
+	float v = nodes[node].data[c * BLOCK_CELLS + cell];
+	if ((b == 1 && (wall & 1)) || (b == 2 && (wall & 2))) v = -v;
+	return v;
+}
+
+int AmrFluidsim::refineAt(int x, int y) {
+	float X = x - 0.5f;
+	float Y = y - 0.5f;
+	bool changed = false;
+	int node = findLeaf(X, Y);
+	while (nodes[node].level < maxLevel) {
+		split(node);
+		changed = true;
+		node = findLeaf(X, Y);
+	}
+	if (changed) rebuildLeaves();
+
+	int cell, wall;
+	locate(X, Y, node, cell, wall);
+	return node * BLOCK_CELLS + cell;
+}
+
+void AmrFluidsim::addDensity(int x, int y, float amount) {
+	if (x < 1 || x > Nx || y < 1 || y > Ny) return;
+	int at = refineAt(x, y);
+	nodes[at / BLOCK_CELLS].data[DENSITY * BLOCK_CELLS + at % BLOCK_CELLS] += amount;
+}
+
+void AmrFluidsim::addVelocity(int x, int y, float amountX, float amountY) {
+	if (x < 1 || x > Nx || y < 1 || y > Ny) return;
+	int at = refineAt(x, y);
+	nodes[at / BLOCK_CELLS].data[VX * BLOCK_CELLS + at % BLOCK_CELLS] += amountX;
+	nodes[at / BLOCK_CELLS].data[VY * BLOCK_CELLS + at % BLOCK_CELLS] += amountY;
+}
+
+void AmrFluidsim::readDensity(float* out) const {
+	for (size_t l = 0; l < leaves.size(); l++) {
+		const Node& n = nodes[leaves[l]];
+		int s = scale(n.level);
+		int x0 = n.ix * B * s;
+		int y0 = n.iy * B * s;
+		const float* d = n.data.data() + DENSITY * BLOCK_CELLS;
+		for (int y = 0; y < B * s; y++) {
+			for (int x = 0; x < B * s; x++) {
+				out[(x0 + x) + (y0 + y) * Nx] = d[x / s + (y / s) * B];
+			}
+		}
+	}
+}
+
+void AmrFluidsim::step() {
+	diffuse(1, VX0, VX, visc, dt);
+	diffuse(2, VY0, VY, visc, dt);
+
+	project(VX0, VY0, VX, VY);
+
+	advect(1, VX, VX0, VX0, VY0, dt);
+	advect(2, VY, VY0, VX0, VY0, dt);
+
+	project(VX, VY, VX0, VY0);
+
+	diffuse(0, S, DENSITY, diff, dt);
+	advect(0, DENSITY, S, VX, VY, dt);
+
+	for (size_t l = 0; l < leaves.size(); l++) {
+		float* d = channel(nodes[leaves[l]], DENSITY);
+		for (int i = 0; i < BLOCK_CELLS; i++) {
+			d[i] *= 0.995f;
+		}
+	}
+
+	regrid();
+}
+
+// Children take their parent's cell values (injection), so refining moves no
+// mass; merging averages each 2x2 group back into one cell.
+void AmrFluidsim::split(int node) {
+	int q;
+	if (!freeQuads.empty()) {
+		q = freeQuads.back();
+		freeQuads.pop_back();
+	}
+	else {
+		q = (int)nodes.size();
+		nodes.resize(nodes.size() + 4);
+	}
+
+	Node& parent = nodes[node];
+	for (int k = 0; k < 4; k++) {
+		Node& child = nodes[q + k];
+		child.level = parent.level + 1;
+		child.ix = 2 * parent.ix + (k & 1);
+		child.iy = 2 * parent.iy + (k >> 1);
+		child.child = -1;
+		child.data.resize(CHANNELS * BLOCK_CELLS);
+		for (int c = 0; c < CHANNELS; c++) {
+			const float* src = parent.data.data() + c * BLOCK_CELLS;
+			float* dst = child.data.data() + c * BLOCK_CELLS;
+			for (int j = 0; j < B; j++) {
+				for (int i = 0; i < B; i++) {
+					dst[i + j * B] = src[((k & 1) * B + i) / 2 + (((k >> 1) * B + j) / 2) * B];
+				}
+			}
+		}
+	}
+	std::vector<float>().swap(parent.data);
+	parent.child = q;
+}
+
+void AmrFluidsim::merge(int node) {
+	Node& parent = nodes[node];
+	int q = parent.child;
+	parent.data.resize(CHANNELS * BLOCK_CELLS);
+	for (int c = 0; c < CHANNELS; c++) {
+		float* dst = parent.data.data() + c * BLOCK_CELLS;
+		for (int j = 0; j < B; j++) {
+			for (int i = 0; i < B; i++) {
+				int k = (i >= B / 2) + 2 * (j >= B / 2);
+				const float* src = nodes[q + k].data.data() + c * BLOCK_CELLS;
+				int ci = 2 * i - (k & 1) * B;
+				int cj = 2 * j - (k >> 1) * B;
+				dst[i + j * B] = 0.25f * (src[ci + cj * B] + src[ci + 1 + cj * B] + src[ci + (cj + 1) * B] + src[ci + 1 + (cj + 1) * B]);
+			}
+		}
+	}
+	for (int k = 0; k < 4; k++) {
+		std::vector<float>().swap(nodes[q + k].data);
+	}
+	parent.child = -1;
+	freeQuads.push_back(q);
+}
+
+BlockStats AmrFluidsim::measure(int leafIndex) {
+	Node& n = nodes[leaves[leafIndex]];
+	BlockStats stats;
+	stats.level = n.level;
+	stats.maxVorticity = 0.0f;
+	stats.maxDensityGradient = 0.0f;
+	stats.maxDensity = 0.0f;
+
+	gatherPadded(VX, leafIndex, 1, padded);
+	gatherPadded(VY, leafIndex, 2, paddedY);
+	for (int j = 1; j <= B; j++) {
+		for (int i = 1; i <= B; i++) {
+			int pi = i + j * PB;
+			float w = 0.5f * std::fabs((paddedY[pi + 1] - paddedY[pi - 1]) - (padded[pi + PB] - padded[pi - PB]));
+			stats.maxVorticity = std::max(stats.maxVorticity, w);
+		}
+	}
+
+	gatherPadded(DENSITY, leafIndex, 0, padded);
+	for (int j = 1; j <= B; j++) {
+		for (int i = 1; i <= B; i++) {
+			int pi = i + j * PB;
+			float gx = padded[pi + 1] - padded[pi - 1];
+			float gy = padded[pi + PB] - padded[pi - PB];
+			stats.maxDensityGradient = std::max(stats.maxDensityGradient, 0.5f * std::sqrt(gx * gx + gy * gy));
+			stats.maxDensity = std::max(stats.maxDensity, padded[pi]);
+		}
+	}
+	return stats;
+}
+
+void AmrFluidsim::regrid() {
+	std::vector<int> action(nodes.size(), 0);
+	for (size_t l = 0; l < leaves.size(); l++) {
+		BlockStats stats = measure((int)l);
+		int a;
+		if (predicate) {
+			a = predicate(stats);
+		}
+		else if (stats.maxVorticity > criteria.vorticity || stats.maxDensityGradient > criteria.densityGradient) {
+			a = 1;
+		}
+		else if (stats.maxVorticity < criteria.coarsenFraction * criteria.vorticity &&
+			stats.maxDensityGradient < criteria.coarsenFraction * criteria.densityGradient) {
+			a = -1;
+		}
+		else {
+			a = 0;
+		}
+		action[leaves[l]] = a;
+	}
+
+	// Merge before splitting so a block is never refined and coarsened in one pass.
+	bool changed = false;
+	size_t count = nodes.size();
+	for (size_t i = 0; i < count; i++) {
+		int q = nodes[i].child;
+		if (q < 0) continue;
+		bool quiet = true;
+		for (int k = 0; k < 4 && quiet; k++) {
+			quiet = nodes[q + k].child < 0 && action[q + k] < 0;
+		}
+		if (quiet) {
+			merge((int)i);
+			changed = true;
+		}
+	}
+	for (size_t l = 0; l < leaves.size(); l++) {
+		int node = leaves[l];
+		if (action[node] > 0 && nodes[node].child < 0 && nodes[node].level < maxLevel) {
+			split(node);
+			changed = true;
+		}
+	}
+
+	if (changed) rebuildLeaves();
+}
+
+void AmrFluidsim::rebuildLeaves() {
+	leaves.clear();
+	std::vector<int> stack;
+	for (int r = rootsX * rootsY - 1; r >= 0; r--) {
+		stack.push_back(r);
+	}
+	while (!stack.empty()) {
+		int node = stack.back();
+		stack.pop_back();
+		if (nodes[node].child < 0) {
+			leaves.push_back(node);
+		}
+		else {
+			for (int k = 3; k >= 0; k--) {
+				stack.push_back(nodes[node].child + k);
+			}
+		}
+	}
+
+	ghosts.resize(leaves.size() * GHOSTS);
+	for (size_t l = 0; l < leaves.size(); l++) {
+		const Node& n = nodes[leaves[l]];
+		float s = (float)scale(n.level);
+		float ox = n.ix * B * s;
+		float oy = n.iy * B * s;
+		Ghost* g = &ghosts[l * GHOSTS];
+		for (int k = 0; k < B; k++) {
+			float along = (k + 0.5f) * s;
+			locate(ox - 0.5f * s, oy + along, g[k].node, g[k].cell, g[k].wall);
+			locate(ox + (B + 0.5f) * s, oy + along, g[B + k].node, g[B + k].cell, g[B + k].wall);
+			locate(ox + along, oy - 0.5f * s, g[2 * B + k].node, g[2 * B + k].cell, g[2 * B + k].wall);
+			locate(ox + along, oy + (B + 0.5f) * s, g[3 * B + k].node, g[3 * B + k].cell, g[3 * B + k].wall);
+		}
+	}
+
+	faceLinks.clear();
+	faceStart.clear();
+	for (size_t l = 0; l < leaves.size(); l++) {
+		const Node& n = nodes[leaves[l]];
+		int s = scale(n.level);
+		float ox = (float)n.ix * B * s;
+		float oy = (float)n.iy * B * s;
+		for (int side = 0; side < 4; side++) {
+			for (int k = 0; k < B; k++) {
+				faceStart.push_back((int)faceLinks.size());
+				if (side == 0) linkFace(ox - 0.5f, oy + k * s, true, s);
+				else if (side == 1) linkFace(ox + B * s + 0.5f, oy + k * s, true, s);
+				else if (side == 2) linkFace(ox + k * s, oy - 0.5f, false, s);
+				else linkFace(ox + k * s, oy + B * s + 0.5f, false, s);
+			}
+		}
+	}
+	faceStart.push_back((int)faceLinks.size());
+}
+
+// Links the face of a cell of size s (finest cells) to the cells beyond it.
+// (X, Y) is half a finest cell outside the face at its start; the face is
+// walked one finest cell at a time and runs in the same neighbour are merged.
+// Beyond a domain wall locate returns the cell itself, as set_bnd would.
+void AmrFluidsim::linkFace(float X, float Y, bool alongY, int s) {
+	size_t first = faceLinks.size();
+	for (int t = 0; t < s; t++) {
+		int node, cell, wall;
+		locate(alongY ? X : X + t + 0.5f, alongY ? Y + t + 0.5f : Y, node, cell, wall);
+		if (faceLinks.size() > first && faceLinks.back().node == node && faceLinks.back().cell == cell) {
+			faceLinks.back().length += 1.0f;
+		}
+		else {
+			FaceLink link = { node, cell, wall, 1.0f, 0.0f };
+			faceLinks.push_back(link);
+		}
+	}
+	// sub-face length over centre distance, 1 between cells of one size
+	for (size_t k = first; k < faceLinks.size(); k++) {
+		float other = (float)scale(nodes[faceLinks[k].node].level);
+		faceLinks[k].weight = faceLinks[k].length / (0.5f * (s + other));
+	}
+}
+
+// Weighted sum of channel c over the links of one edge cell face; adds the
+// weights to `weight`.
+float AmrFluidsim::faceSum(int c, int face, float& weight) const {
+	float sum = 0.0f;
+	for (int k = faceStart[face]; k < faceStart[face + 1]; k++) {
+		const FaceLink& link = faceLinks[k];
+		sum += link.weight * nodes[link.node].data[c * BLOCK_CELLS + link.cell];
+		weight += link.weight;
+	}
+	return sum;
+}
+
+// Channel c over the links of one edge cell face, weighted by sub-face length
+// (finest cells); values beyond a wall in `flip` change sign, as in set_bnd.
+float AmrFluidsim::faceFlow(int c, int face, int flip) const {
+	float sum = 0.0f;
+	for (int k = faceStart[face]; k < faceStart[face + 1]; k++) {
+		const FaceLink& link = faceLinks[k];
+		float v = nodes[link.node].data[c * BLOCK_CELLS + link.cell];
+		sum += link.length * ((link.wall & flip) ? -v : v);
+	}
+	return sum;
+}
+
+// Copies a leaf and its ghost ring into a (B+2)^2 buffer. Ghosts come from the
+// covering cell of whichever leaf holds them, at that leaf's resolution.
+void AmrFluidsim::gatherPadded(int c, int leafIndex, int b, float* out) {
+	const float* src = channel(nodes[leaves[leafIndex]], c);
+	for (int j = 0; j < B; j++) {
+		std::copy(src + j * B, src + (j + 1) * B, out + (j + 1) * PB + 1);
+	}
+
+	const Ghost* g = &ghosts[leafIndex * GHOSTS];
+	int flip = (b == 1) ? 1 : (b == 2) ? 2 : 0;
+	for (int k = 0; k < GHOSTS; k++) {
+		float v = nodes[g[k].node].data[c * BLOCK_CELLS + g[k].cell];
+		if (g[k].wall & flip) v = -v;
+		int side = k / B, at = k % B + 1;
+		int pi = (side == 0) ? at * PB : (side == 1) ? at * PB + B + 1 : (side == 2) ? at : (B + 1) * PB + at;
+		out[pi] = v;
+	}
+}
+
+void AmrFluidsim::diffuse(int b, int x, int x0, float diff, float dt) {
+	// With no diffusion every sweep reduces to a copy.
+	if (diff == 0.0f) {
+		for (size_t l = 0; l < leaves.size(); l++) {
+			Node& n = nodes[leaves[l]];
+			std::copy(channel(n, x0), channel(n, x0) + BLOCK_CELLS, channel(n, x));
+		}
+		return;
+	}
+
+	for (int k = 0; k < 20; k++) {
+		for (size_t l = 0; l < leaves.size(); l++) {
+			Node& n = nodes[leaves[l]];
+			float h = cellH(n);
+			float a = dt * diff / (h * h);
+			gatherPadded(x, (int)l, b, padded);
+			const float* src = channel(n, x0);
+			float* dst = channel(n, x);
+			for (int j = 1; j <= B; j++) {
+				for (int i = 1; i <= B; i++) {
+					int pi = i + j * PB;
+					padded[pi] = (src[(i - 1) + (j - 1) * B] + a * (padded[pi - 1] + padded[pi + 1] + padded[pi - PB] + padded[pi + PB])) / (1 + 4 * a);
+					dst[(i - 1) + (j - 1) * B] = padded[pi];
+				}
+			}
+		}
+	}
+}
+
+void AmrFluidsim::project(int velocX, int velocY, int p, int div) {
+	// The flow through a face is its length times the mean velocity of the
+	// cells on either side; the cell's own share cancels between its
+	// opposite faces, leaving the neighbours' length-weighted velocities.
+	for (size_t l = 0; l < leaves.size(); l++) {
+		Node& n = nodes[leaves[l]];
+		float s = (float)scale(n.level);
+		const float* u = channel(n, velocX);
+		const float* v = channel(n, velocY);
+		float* d = channel(n, div);
+		float* pp = channel(n, p);
+		int face = (int)l * GHOSTS;
+		for (int j = 0; j < B; j++) {
+			for (int i = 0; i < B; i++) {
+				int local = i + j * B;
+				float left = (i > 0) ? s * u[local - 1] : faceFlow(velocX, face + j, 1);
+				float right = (i < B - 1) ? s * u[local + 1] : faceFlow(velocX, face + B + j, 1);
+				float down = (j > 0) ? s * v[local - B] : faceFlow(velocY, face + 2 * B + i, 2);
+				float up = (j < B - 1) ? s * v[local + B] : faceFlow(velocY, face + 3 * B + i, 2);
+				d[local] = -0.5f * (right - left + up - down) * hFine;
+				pp[local] = 0.0f;
+			}
+		}
+	}
+
+	// p is a physical quantity (it scales with h^2 times the divergence).
+	// Inside a block every face has weight 1; edge cells take their
+	// neighbours from the face links, so a level change keeps the fluxes
+	// of both sides equal.
+	for (int k = 0; k < 20; k++) {
+		for (size_t l = 0; l < leaves.size(); l++) {
+			Node& n = nodes[leaves[l]];
+			const float* d = channel(n, div);
+			float* pp = channel(n, p);
+			int face = (int)l * GHOSTS;
+			auto edgeCell = [&](int i, int j) {
+				int local = i + j * B;
+				float weight = 0.0f;
+				float sum = 0.0f;
+				if (i > 0) { sum += pp[local - 1]; weight += 1.0f; }
+				else sum += faceSum(p, face + j, weight);
+				if (i < B - 1) { sum += pp[local + 1]; weight += 1.0f; }
+				else sum += faceSum(p, face + B + j, weight);
+				if (j > 0) { sum += pp[local - B]; weight += 1.0f; }
+				else sum += faceSum(p, face + 2 * B + i, weight);
+				if (j < B - 1) { sum += pp[local + B]; weight += 1.0f; }
+				else sum += faceSum(p, face + 3 * B + i, weight);
+				pp[local] = (d[local] + sum) / weight;
+			};
+			for (int i = 0; i < B; i++) edgeCell(i, 0);
+			for (int j = 1; j < B - 1; j++) {
+				edgeCell(0, j);
+				for (int i = 1; i < B - 1; i++) {
+					int local = i + j * B;
+					pp[local] = (d[local] + pp[local - 1] + pp[local + 1] + pp[local - B] + pp[local + B]) / 4;
+				}
+				edgeCell(B - 1, j);
+			}
+			for (int i = 0; i < B; i++) edgeCell(i, B - 1);
+		}
+	}
+
+	// The gradient across a face is the weighted pressure difference over
+	// its links; a cell moves by the mean of its two opposite faces.
+	for (size_t l = 0; l < leaves.size(); l++) {
+		Node& n = nodes[leaves[l]];
+		float h = cellH(n);
+		const float* pp = channel(n, p);
+		float* u = channel(n, velocX);
+		float* v = channel(n, velocY);
+		int face = (int)l * GHOSTS;
+		auto across = [&](int f, float pc) {
+			float weight = 0.0f;
+			float sum = faceSum(p, f, weight);
+			return sum - weight * pc;
+		};
+		for (int j = 0; j < B; j++) {
+			for (int i = 0; i < B; i++) {
+				int local = i + j * B;
+				float pc = pp[local];
+				float left = (i > 0) ? pc - pp[local - 1] : -across(face + j, pc);
+				float right = (i < B - 1) ? pp[local + 1] - pc : across(face + B + j, pc);
+				float down = (j > 0) ? pc - pp[local - B] : -across(face + 2 * B + i, pc);
+				float up = (j < B - 1) ? pp[local + B] - pc : across(face + 3 * B + i, pc);
+				u[local] -= 0.5f * (left + right) / h;
+				v[local] -= 0.5f * (down + up) / h;
+			}
+		}
+	}
+}
+
+// Backtraces in finest-cell units and interpolates at the resolution of the
+// destination block; stencil corners that fall in another block are read from
+// whichever leaf covers them.
+void AmrFluidsim::advect(int b, int d, int d0, int velocX, int velocY, float dt) {
+	float dt0 = dt / hFine;
+
+	for (size_t l = 0; l < leaves.size(); l++) {
+		Node& n = nodes[leaves[l]];
+		int s = scale(n.level);
+		float sf = (float)s;
+		int gx0 = n.ix * B;
+		int gy0 = n.iy * B;
+		float* dst = channel(n, d);
+		const float* src = channel(n, d0);
+		const float* u = channel(n, velocX);
+		const float* v = channel(n, velocY);
+
+		for (int j = 0; j < B; j++) {
+			for (int i = 0; i < B; i++) {
+				int local = i + j * B;
+				float X = std::min(std::max((gx0 + i + 0.5f) * sf - dt0 * u[local], 0.0f), (float)Nx);
+				float Y = std::min(std::max((gy0 + j + 0.5f) * sf - dt0 * v[local], 0.0f), (float)Ny);
+				float fx = X / sf - 0.5f;
+				float fy = Y / sf - 0.5f;
+				int i0 = (int)std::floor(fx);
+				int j0 = (int)std::floor(fy);
+				float s1 = fx - i0, s0 = 1.0f - s1;
+				float t1 = fy - j0, t0 = 1.0f - t1;
+
+				int li = i0 - gx0;
+				int lj = j0 - gy0;
+				float v00, v10, v01, v11;
+				if (li >= 0 && li < B - 1 && lj >= 0 && lj < B - 1) {
+					const float* at = src + li + lj * B;
+					v00 = at[0];
+					v10 = at[1];
+					v01 = at[B];
+					v11 = at[B + 1];
+				}
+				else {
+					v00 = cellValue(d0, (i0 + 0.5f) * sf, (j0 + 0.5f) * sf, b);
+					v10 = cellValue(d0, (i0 + 1.5f) * sf, (j0 + 0.5f) * sf, b);
+					v01 = cellValue(d0, (i0 + 0.5f) * sf, (j0 + 1.5f) * sf, b);
+					v11 = cellValue(d0, (i0 + 1.5f) * sf, (j0 + 1.5f) * sf, b);
+				}
+				dst[local] = s0 * (t0 * v00 + t1 * v01) + s1 * (t0 * v10 + t1 * v11);
+			}
+		}
+	}
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+
+// Per-block measurements handed to the refinement predicate. Differences are
+// undivided (per cell of the block's own level), so they shrink as a smooth
+// region is refined and the tree stops growing once detail is resolved.
+struct BlockStats {
+	int level;
+	float maxVorticity;
+	float maxDensityGradient;
+	float maxDensity;
+};
+
+// Default criteria: refine a block when either indicator exceeds its
+// threshold, coarsen four sibling blocks when all of them fall below
+// coarsenFraction of both thresholds.
+struct RefinementCriteria {
+	float vorticity;
+	float densityGradient;
+	float coarsenFraction;
+};
+
+// Returns +1 to refine the block, -1 to allow coarsening, 0 to keep it.
+typedef std::function<int(const BlockStats&)> RefinementPredicate;
+
+// Stam's solver on a quadtree of BLOCK_SIZE x BLOCK_SIZE blocks. The domain is
+// rootsX x rootsY root blocks, maxLevel levels coarser than the finest, so the
+// finest level (the equivalent uniform Fluidsim) is getWidth() x getHeight() =
+// rootsX x rootsY times BLOCK_SIZE << maxLevel cells. Diffusion
+// and projection sweep each block with neighbour values read from whatever
+// block covers them; advection samples across levels. Refinement and
+// coarsening run at the end of every step.
+//
+// The projection couples levels through face fluxes: a cell face shared with
+// finer cells is split into their sub-faces. The divergence takes the flow
+// through each sub-face from its length and the mean velocity of the two
+// cells; the Laplacian and the gradient weight each pressure difference by
+// the sub-face length over the distance between the two cell centres. Both
+// sides of a sub-face see the same fluxes in all three, so what one cell
+// loses the other gains.
+class AmrFluidsim {
+public:
+	static const int BLOCK_SIZE = 16;
+
+	// Sizing by roots keeps the domain a whole number of blocks at every level.
+	AmrFluidsim(int rootsX, int rootsY, int maxLevel);
+
+	void step();
+	// x, y are 1-based cells of the finest level; the block containing the
+	// cell is refined to the finest level first, as sources are always detail.
+	void addDensity(int x, int y, float amount);
+	void addVelocity(int x, int y, float amountX, float amountY);
+
+	void setRefinementCriteria(const RefinementCriteria& criteria) { this->criteria = criteria; }
+	// Replaces the threshold test; pass an empty function to go back to it.
+	void setRefinementPredicate(const RefinementPredicate& predicate) { this->predicate = predicate; }
+
+	// Fills Nx * Ny row-major values at finest resolution (coarse cells repeated).
+	void readDensity(float* out) const;
+
+	int getWidth() const { return Nx; }
+	int getHeight() const { return Ny; }
+	int getMaxLevel() const { return maxLevel; }
+	int getBlockCount() const { return (int)leaves.size(); }
+	int getCellCount() const { return (int)leaves.size() * BLOCK_CELLS; }
+	float getTimeStep() const { return dt; }
+	void setTimeStep(float dt) { this->dt = dt; }
+
+private:
+	enum Channel { DENSITY, S, VX, VY, VX0, VY0 };
+	static const int CHANNELS = 6;
+	static const int B = BLOCK_SIZE;
+	static const int BLOCK_CELLS = B * B;
+	static const int PB = B + 2;
+	static const int GHOSTS = 4 * B;
+
+	struct Node {
+		int level;
+		int ix;
+		int iy;
+		// first of four consecutive children, or -1 for a leaf
+		int child;
+		// CHANNELS * BLOCK_CELLS floats while the node is a leaf
+		std::vector<float> data;
+	};
+
+	// Where a ghost cell of a leaf reads from; wall bits say which domain
+	// walls it lies beyond, for the sign flips of set_bnd.
+	struct Ghost {
+		int node;
+		int cell;
+		int wall;
+	};
+
+	// One neighbour across a block edge in the projection: the sub-face
+	// length in finest cells, its weight (length / centre distance) and the
+	// wall bits of the neighbour, as for Ghost.
+	struct FaceLink {
+		int node;
+		int cell;
+		int wall;
+		float length;
+		float weight;
+	};
+
+	int Nx;
+	int Ny;
+	int maxLevel;
+	int rootsX;
+	int rootsY;
+	float hFine;
+
+	float dt;
+	float diff;
+	float visc;
+
+	RefinementCriteria criteria;
+	RefinementPredicate predicate;
+
+	std::vector<Node> nodes;
+	std::vector<int> freeQuads;
+	std::vector<int> leaves;
+	// GHOSTS entries per leaf, in the order of `leaves`
+	std::vector<Ghost> ghosts;
+	// GHOSTS per leaf in the same order, plus an end marker: where the links
+	// of each edge cell face start in faceLinks
+	std::vector<FaceLink> faceLinks;
+	std::vector<int> faceStart;
+	float padded[PB * PB];
+	float paddedY[PB * PB];
+
+	int scale(int level) const { return 1 << (maxLevel - level); }
+	float cellH(const Node& n) const { return hFine * scale(n.level); }
+	float* channel(Node& n, int c) { return n.data.data() + c * BLOCK_CELLS; }
+
+	int findLeaf(float X, float Y) const;
+	void locate(float X, float Y, int& node, int& cell, int& wall) const;
+	float cellValue(int c, float X, float Y, int b) const;
+	int refineAt(int x, int y);
+
+	void split(int node);
+	void merge(int node);
+	void regrid();
+	void rebuildLeaves();
+	void linkFace(float X, float Y, bool alongY, int s);
+	float faceSum(int c, int face, float& weight) const;
+	float faceFlow(int c, int face, int flip) const;
+	BlockStats measure(int leafIndex);
+
+	void gatherPadded(int c, int leafIndex, int b, float* out);
+
+	void diffuse(int b, int x, int x0, float diff, float dt);
+	void project(int velocX, int velocY, int p, int div);
+	void advect(int b, int d, int d0, int velocX, int velocY, float dt);
+};
@@ -0,0 +1,644 @@
+#include "Benchmark.h"
+#include "Fluidsim.h"
+#include "MacFluidsim.h"
+#include "UnmaskedFluidsim.h"
+#include "AmrFluidsim.h"
+#include "ResolutionGovernor.h"
+#include "QualityGovernor.h"
+#include "BenchmarkReport.h"
+#include "PerfCounters.h"
+#include "Profiler.h"
+#include "Validation.h"
+#include "FloatMode.h"
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// interleaved runs per solver in the mask overhead section
+static const int MASK_REPEATS = 5;
+
+static void injectSource(Fluidsim& sim) {
+	int x = sim.getWidth() / 8;
+	int y = sim.getHeight() / 2;
+	sim.addDensity(x, y, 200.0f);
+	sim.addVelocity(x, y, 2.0f, 0.0f);
+}
+
+static void addCityScene(Fluidsim& sim, int N) {
+	for (int k = 0; k < 4; k++) {
+		int x0 = N / 3 + k * N / 8;
+		sim.addObstacleRect(x0, 1, x0 + N / 16, N / 4 + (k % 2) * N / 8);
+	}
+	sim.addObstacleCircle(N / 4, N / 2, N / 12);
+	sim.addObstacleRect(N / 2, 3 * N / 4, 3 * N / 4, 3 * N / 4 + N / 32);
+}
+
+// counts: if given, the counters' deltas over the timed steps.
+static double timeSteps(Fluidsim& sim, int steps, const PerfCounters* counters = nullptr, PerfSample* counts = nullptr) {
+	for (int i = 0; i < 5; i++) {
+		injectSource(sim);
+		sim.step();
+	}
+
+	PerfSample before;
+	if (counts != nullptr) counters->read(before);
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < steps; i++) {
+		injectSource(sim);
+		sim.step();
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	if (counts != nullptr) {
+		counters->read(*counts);
+		*counts = counts->since(before);
+	}
+
+	return std::chrono::duration<double, std::milli>(end - start).count() / steps;
+}
+
+// Average cost of re-rasterising a circle that slides one cell per frame.
+static double timeObstacleUpdate(int N, float radius, int frames) {
+	Fluidsim sim(N);
+	MovingObstacle paddle = MovingObstacle::circle(radius);
+	paddle.setPose(N / 4.0f, N / 2.0f, 0.0f);
+	sim.addMovingObstacle(&paddle);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < frames; i++) {
+		paddle.setPose(N / 4.0f + (i % (N / 2)), N / 2.0f, 0.0f);
+		paddle.setVelocity(1.0f, 0.0f, 0.0f);
+		sim.updateMovingObstacles();
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+
+	return std::chrono::duration<double, std::micro>(end - start).count() / frames;
+}
+
+struct SchemeResult {
+	double msPerStep;
+	double energyKept;
+	double checkerboard;
+};
+
+static double kineticEnergy(float* velX, float* velY, int Nx, int Ny) {
+	double e = 0.0;
+	for (int j = 1; j <= Ny; j++) {
+		for (int i = 1; i <= Nx; i++) {
+			int idx = i + j * (Nx + 2);
+			e += velX[idx] * velX[idx] + velY[idx] * velY[idx];
+		}
+	}
+	return 0.5 * e / ((double)Nx * Ny);
+}
+
+// RMS of the (-1)^(i+j) mode over 2x2 blocks relative to the RMS velocity:
+// the pattern a collocated projection cannot see.
+static double checkerboardRatio(float* velX, float* velY, int Nx, int Ny) {
+	double cb = 0.0, total = 0.0;
+	for (int j = 1; j < Ny; j += 2) {
+		for (int i = 1; i < Nx; i += 2) {
+			int a = i + j * (Nx + 2), b = a + 1, c = a + (Nx + 2), d = c + 1;
+			double cx = 0.25 * (velX[a] - velX[b] - velX[c] + velX[d]);
+			double cy = 0.25 * (velY[a] - velY[b] - velY[c] + velY[d]);
+			cb += 4.0 * (cx * cx + cy * cy);
+			total += velX[a] * velX[a] + velX[b] * velX[b] + velX[c] * velX[c] + velX[d] * velX[d]
+				+ velY[a] * velY[a] + velY[b] * velY[b] + velY[c] * velY[c] + velY[d] * velY[d];
+		}
+	}
+	return (total > 0.0) ? std::sqrt(cb / total) : 0.0;
+}
+
+// Spins up a vortex with a density ring, then measures how much of it survives.
+template <typename Sim>
+static SchemeResult runVortexScene(Sim& sim, int steps) {
+	int Nx = sim.getWidth(), Ny = sim.getHeight();
+	float cx = Nx * 0.5f, cy = Ny * 0.5f, radius = Nx * 0.25f;
+	for (int j = 1; j <= Ny; j++) {
+		for (int i = 1; i <= Nx; i++) {
+			float dx = i - cx, dy = j - cy;
+			float r = std::sqrt(dx * dx + dy * dy);
+			if (r > radius) continue;
+			float speed = 0.05f * r / radius;
+			sim.addVelocity(i, j, -speed * dy / (r + 1e-6f), speed * dx / (r + 1e-6f));
+			if (r > 0.5f * radius) sim.addDensity(i, j, 1.0f);
+		}
+	}
+	sim.step();
+	double e0 = kineticEnergy(sim.getVelocityXArray(), sim.getVelocityYArray(), Nx, Ny);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < steps; i++) {
+		sim.step();
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+
+	SchemeResult result;
+	result.msPerStep = std::chrono::duration<double, std::milli>(end - start).count() / steps;
+	result.energyKept = kineticEnergy(sim.getVelocityXArray(), sim.getVelocityYArray(), Nx, Ny) / e0;
+	result.checkerboard = checkerboardRatio(sim.getVelocityXArray(), sim.getVelocityYArray(), Nx, Ny);
+	return result;
+}
+
+static void printScheme(const char* name, int n, const SchemeResult& r) {
+	std::cout << "  " << name << " N = " << n << ": " << r.msPerStep << " ms/step, energy kept "
+		<< r.energyKept * 100.0 << " %, checkerboard " << r.checkerboard << std::endl;
+}
+
+static void printCounters(const char* label, double ms, const PerfSample& c, int steps) {
+	std::cout << "  " << std::left << std::setw(14) << label << std::right << std::setw(9) << ms / steps;
+	for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+		if (c.value[e] < 0) std::cout << std::setw(14) << "-";
+		else std::cout << std::setw(14) << c.value[e] / steps;
+	}
+	if (c.value[PERF_CYCLES] > 0 && c.value[PERF_INSTRUCTIONS] >= 0) {
+		std::cout << std::setw(7) << std::setprecision(3) << (double)c.value[PERF_INSTRUCTIONS] / c.value[PERF_CYCLES] << std::setprecision(6);
+	}
+	std::cout << std::endl;
+}
+
+bool parseBenchmarkOptions(int argc, char** argv, BenchmarkOptions& options) {
+	int positional[2] = { options.N, options.steps };
+	int positionalCount = 0;
+	bool badArgs = false;
+	for (int i = 2; i < argc; i++) {
+		if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) options.jsonPath = argv[++i];
+		else if (std::strcmp(argv[i], "--csv") == 0 && i + 1 < argc) options.csvPath = argv[++i];
+		else if (std::strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) options.baselinePath = argv[++i];
+		else if (std::strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) options.threshold = (float)std::atof(argv[++i]);
+		else if (argv[i][0] != '-' && positionalCount < 2) positional[positionalCount++] = std::atoi(argv[i]);
+		else badArgs = true;
+	}
+	options.N = positional[0];
+	options.steps = positional[1];
+	if (badArgs || options.N < 16 || options.steps < 1) {
+		std::cerr << "usage: " << argv[1] << " [N >= 16] [steps >= 1] [--json <path>] [--csv <path>] [--baseline <path>] [--threshold <percent>]" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+ScopedThreadCount::ScopedThreadCount(int threads) {
+#ifdef _OPENMP
+	this->previous = omp_get_max_threads();
+	omp_set_num_threads(threads);
+#else
+	(void)threads;
+	this->previous = 1;
+#endif
+}
+
+ScopedThreadCount::~ScopedThreadCount() {
+#ifdef _OPENMP
+	omp_set_num_threads(previous);
+#endif
+}
+
+template <typename Sim>
+static void fillSwirl(Sim& sim) {
+	int Nx = sim.getWidth(), Ny = sim.getHeight();
+	for (int j = 1; j <= Ny; j++) {
+		for (int i = 1; i <= Nx; i++) {
+			float x = (float)i / Nx, y = (float)j / Ny;
+			sim.addDensity(i, j, 1.0f);
+			sim.addVelocity(i, j, 0.5f * std::sin(6.2832f * y), 0.5f * std::sin(6.2832f * x));
+		}
+	}
+}
+
+void addSwirl(Fluidsim& sim) {
+	fillSwirl(sim);
+}
+
+// A swirl keeps every tile active, so the masked solver does the same work
+// per cell as the unmasked one.
+template <typename Sim>
+static void startSwirl(Sim& sim) {
+	fillSwirl(sim);
+	for (int i = 0; i < 5; i++) sim.step();
+}
+
+template <typename Sim>
+static double timeSwirl(Sim& sim, int steps) {
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < steps; i++) sim.step();
+	auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count() / steps;
+}
+
+int runBenchmark(int argc, char** argv) {
+	BenchmarkOptions options(256, 50);
+	if (!parseBenchmarkOptions(argc, argv, options)) return 1;
+	int N = options.N;
+	int steps = options.steps;
+	const char* jsonPath = options.jsonPath;
+
+	BenchmarkReport report;
+	report.setInfo("n", N);
+	report.setInfo("steps", steps);
+
+	PerfCounters counters;
+	bool haveCounters = counters.open();
+	report.setCountersAvailable(haveCounters, counters.getError());
+
+	Fluidsim open(N);
+	double openMs = timeSteps(open, steps);
+
+	Fluidsim city(N);
+	addCityScene(city, N);
+	double cityMs = timeSteps(city, steps);
+
+	std::cout << "N = " << N << ", " << steps << " steps" << std::endl;
+	std::cout << "no obstacles:   " << openMs << " ms/step" << std::endl;
+	std::cout << "with obstacles: " << cityMs << " ms/step" << std::endl;
+	std::cout << "overhead:       " << (cityMs / openMs - 1.0) * 100.0 << " %" << std::endl;
+	report.setMetric("step_ms.open", openMs);
+	report.setMetric("step_ms.obstacles", cityMs);
+
+	// UnmaskedFluidsim is serial and has no watchdog, so the masked solver runs
+	// on one thread without it; what is left of the difference is the mask (and
+	// the tile spans). The runs are interleaved and the best of each is kept,
+	// so drift hits all three alike.
+	std::cout << "mask overhead (swirl, one thread, ms/step, best of " << MASK_REPEATS << ", target 15 %):" << std::endl;
+	{
+		ScopedThreadCount serial(1);
+		UnmaskedFluidsim unmasked(N);
+		Fluidsim masked(N);
+		Fluidsim maskedCity(N);
+		addCityScene(maskedCity, N);
+		WatchdogSettings off = masked.getWatchdog();
+		off.enabled = false;
+		masked.setWatchdog(off);
+		maskedCity.setWatchdog(off);
+		startSwirl(unmasked);
+		startSwirl(masked);
+		startSwirl(maskedCity);
+		double unmaskedMs = 0.0, maskedMs = 0.0, maskedCityMs = 0.0;
+		for (int r = 0; r < MASK_REPEATS; r++) {
+			double u = timeSwirl(unmasked, steps);
+			double m = timeSwirl(masked, steps);
+			double c = timeSwirl(maskedCity, steps);
+			unmaskedMs = (r == 0) ? u : std::min(unmaskedMs, u);
+			maskedMs = (r == 0) ? m : std::min(maskedMs, m);
+			maskedCityMs = (r == 0) ? c : std::min(maskedCityMs, c);
+		}
+		std::cout << "  unmasked:                " << unmaskedMs << std::endl;
+		std::cout << "  masked, no obstacles:    " << maskedMs << " (" << (maskedMs / unmaskedMs - 1.0) * 100.0 << " %)" << std::endl;
+		std::cout << "  masked, with obstacles:  " << maskedCityMs << " (" << (maskedCityMs / unmaskedMs - 1.0) * 100.0 << " %)" << std::endl;
+		report.setMetric("step_ms.unmasked", unmaskedMs);
+		report.setMetric("step_ms.masked_swirl", maskedMs);
+		report.setMetric("step_ms.masked_swirl_obstacles", maskedCityMs);
+	}
+
+	if (!haveCounters) {
+		std::cout << "hardware counters unavailable: " << counters.getError() << std::endl;
+	}
+	else {
+		// Counters only see the thread that opened them, so these runs are
+		// serial: on more threads the workers' share of the cells would be missing.
+		ScopedThreadCount serial(1);
+		PerfSample openCounts, cityCounts;
+		Fluidsim openSerial(N);
+		double openSerialMs = timeSteps(openSerial, steps, &counters, &openCounts);
+		Fluidsim citySerial(N);
+		addCityScene(citySerial, N);
+		double citySerialMs = timeSteps(citySerial, steps, &counters, &cityCounts);
+		report.setCounters("run.open", openSerialMs * steps, steps, openCounts);
+		report.setCounters("run.obstacles", citySerialMs * steps, steps, cityCounts);
+
+		std::cout << "hardware counters per step (one thread):" << std::endl;
+		std::cout << "  " << std::left << std::setw(14) << "" << std::right << std::setw(9) << "ms";
+		for (int e = 0; e < PERF_EVENT_COUNT; e++) std::cout << std::setw(14) << PerfCounters::eventName(e);
+		std::cout << std::setw(7) << "ipc" << std::endl;
+		printCounters("no obstacles", openSerialMs * steps, openCounts, steps);
+		printCounters("with obstacles", citySerialMs * steps, cityCounts, steps);
+
+#ifdef FLUIDSIM_PROFILE
+		// Per stage, from the profiler's PROFILE_STAGE scopes; nested stages
+		// are included in their parents (step contains all of them). Timing-only
+		// scopes have no counts and are left out.
+		Fluidsim staged(N);
+		Profiler::clear();
+		Profiler::setEnabled(true);
+		Profiler::setCountersEnabled(true);
+		timeSteps(staged, steps);
+		Profiler::setCountersEnabled(false);
+		Profiler::setEnabled(false);
+
+		std::vector<ProfileTotal> totals;
+		Profiler::getTotals(totals);
+		for (size_t i = 0; i < totals.size(); i++) {
+			bool counted = false;
+			for (int e = 0; e < PERF_EVENT_COUNT; e++) counted = counted || totals[i].counters.value[e] >= 0;
+			if (!counted) continue;
+			printCounters(totals[i].name, totals[i].totalMs, totals[i].counters, steps + 5);
+			report.setCounters(std::string("stage.") + totals[i].name, totals[i].totalMs, totals[i].calls, totals[i].counters);
+		}
+		Profiler::clear();
+#else
+		std::cout << "  (per-stage counters need a build with FLUIDSIM_PROFILE)" << std::endl;
+#endif
+	}
+
+	std::cout << "domain shape (ms/step, ns/cell):" << std::endl;
+	const int aspects[][2] = { { 1, 1 }, { 16, 9 }, { 4, 1 } };
+	for (int k = 0; k < 3; k++) {
+		int ny = N * aspects[k][1] / aspects[k][0];
+		Fluidsim tunnel(N, ny);
+		double ms = timeSteps(tunnel, steps);
+		std::cout << "  " << N << " x " << ny << ": " << ms << ", " << ms * 1e6 / ((double)N * ny) << std::endl;
+		report.setMetric("step_ms.aspect_" + std::to_string(aspects[k][0]) + "x" + std::to_string(aspects[k][1]), ms);
+	}
+
+	std::cout << "deterministic mode (swirl, ms/step):" << std::endl;
+	{
+		Fluidsim fast(N);
+		addSwirl(fast);
+		double fastMs = timeSteps(fast, steps);
+		Fluidsim fixed(N);
+		fixed.setDeterministic(true);
+		addSwirl(fixed);
+		double fixedMs = timeSteps(fixed, steps);
+		std::cout << "  default:       " << fastMs << " (" << fast.getSweepBandCount() << " sweep bands)" << std::endl;
+		std::cout << "  deterministic: " << fixedMs << " (" << fixed.getSweepBandCount() << " sweep bands), "
+			<< (fixedMs / fastMs - 1.0) * 100.0 << " % slower" << std::endl;
+		report.setMetric("step_ms.default", fastMs);
+		report.setMetric("step_ms.deterministic", fixedMs);
+
+		// Deterministic mode sweeps one band per tile row, so each colour pass
+		// has at most tilesY / 2 bands to share out; the default mode has two
+		// per thread. Counts above the processors present are oversubscribed.
+#ifdef _OPENMP
+		int processors = omp_get_num_procs();
+#else
+		int processors = 1;
+#endif
+		std::cout << "  by thread count (" << processors << " processors): threads, default, deterministic, overhead" << std::endl;
+		for (int threads = 1; threads <= 8; threads *= 2) {
+			ScopedThreadCount team(threads);
+			Fluidsim fastT(N);
+			addSwirl(fastT);
+			double fastTMs = timeSteps(fastT, steps);
+			Fluidsim fixedT(N);
+			fixedT.setDeterministic(true);
+			addSwirl(fixedT);
+			double fixedTMs = timeSteps(fixedT, steps);
+			std::cout << "  " << std::setw(3) << threads << "  " << fastTMs << "  " << fixedTMs << "  " << (fixedTMs / fastTMs - 1.0) * 100.0 << " %"
+				<< (threads > processors ? "  (oversubscribed)" : "") << std::endl;
+			report.setMetric("step_ms.default_t" + std::to_string(threads), fastTMs);
+			report.setMetric("step_ms.deterministic_t" + std::to_string(threads), fixedTMs);
+		}
+	}
+
+	// Density starts just above FLT_MIN and decays into the subnormal range
+	// within a few steps, as a long session does after many thousands.
+	std::cout << "subnormals (swirl, density near FLT_MIN; ms/step, subnormal cells at the end):" << std::endl;
+	if (!canFlushDenormals()) std::cout << "  (FTZ/DAZ not available on this platform)" << std::endl;
+	{
+		struct FloatVariant {
+			const char* name;
+			bool flush;
+			float snap;
+		};
+		const FloatVariant variants[] = { { "no FTZ, no snap", false, 0.0f }, { "FTZ/DAZ", true, 0.0f }, { "snap only", false, 1e-20f }, { "default", true, 1e-20f } };
+		for (const FloatVariant& v : variants) {
+			Fluidsim sim(N);
+			sim.setFlushDenormals(v.flush);
+			sim.setSnapThreshold(v.snap);
+			addSwirl(sim);
+			float* density = sim.getDensityArray();
+			for (int i = 0; i < (N + 2) * (N + 2); i++) density[i] *= 1.2e-38f;
+			for (int i = 0; i < 60; i++) sim.step();
+
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int i = 0; i < steps; i++) sim.step();
+			auto end = std::chrono::high_resolution_clock::now();
+			double ms = std::chrono::duration<double, std::milli>(end - start).count() / steps;
+			SubnormalCounts c = sim.getSubnormalCounts();
+			std::cout << "  " << std::left << std::setw(16) << v.name << std::right << std::setw(10) << ms
+				<< "   density " << c.density << ", vx " << c.vx << ", vy " << c.vy << ", vx0 " << c.vx0 << ", vy0 " << c.vy0 << std::endl;
+		}
+	}
+
+	std::cout << "blow-up watchdog (swirl, ms/step; a 1e9 velocity kick after " << steps / 2 << " steps):" << std::endl;
+	for (int enabled = 0; enabled <= 1; enabled++) {
+		Fluidsim sim(N);
+		WatchdogSettings settings = sim.getWatchdog();
+		settings.enabled = enabled == 1;
+		sim.setWatchdog(settings);
+		addSwirl(sim);
+		double ms = timeSteps(sim, steps);
+		sim.addVelocity(N / 2, N / 2, 1e9f, 0.0f);
+		sim.step();
+		bool finite = true;
+		for (int i = 0; i < (N + 2) * (N + 2); i++) {
+			finite &= std::isfinite(sim.getVelocityXArray()[i]) && std::fabs(sim.getVelocityXArray()[i]) < 1e6f;
+		}
+		std::cout << "  " << (enabled ? "on:  " : "off: ") << ms << ", " << sim.getWatchdogTrips() << " trips, velocity "
+			<< (finite ? "sane" : "blown up") << " after the kick" << std::endl;
+		report.setMetric(enabled ? "step_ms.watchdog_on" : "step_ms.watchdog_off", ms);
+	}
+
+	std::cout << "collocated vs staggered (vortex, " << steps << " steps):" << std::endl;
+	{
+		Fluidsim collocated(N);
+		printScheme("collocated", N, runVortexScene(collocated, steps));
+		MacFluidsim mac(N);
+		printScheme("MAC       ", N, runVortexScene(mac, steps));
+		MacFluidsim macHalf(N / 2);
+		printScheme("MAC       ", N / 2, runVortexScene(macHalf, steps));
+	}
+
+	std::cout << "adaptive timestep (strong stroke, advance(dt) per frame):" << std::endl;
+	{
+		Fluidsim sim(N);
+		for (int j = N / 2 - 4; j <= N / 2 + 4; j++) {
+			sim.addVelocity(N / 4, j, 5.0f, 0.0f);
+			sim.addDensity(N / 4, j, 100.0f);
+		}
+		int totalSubsteps = 0;
+		double totalMs = 0.0;
+		for (int i = 0; i < steps; i++) {
+			sim.advance(sim.getTimeStep());
+			totalSubsteps += sim.getLastSubsteps();
+			totalMs += sim.getLastFrameMs();
+		}
+		std::cout << "  " << (double)totalSubsteps / steps << " substeps/frame, " << totalMs / steps << " ms/frame" << std::endl;
+		report.setMetric("frame_ms.adaptive_timestep", totalMs / steps);
+	}
+
+	std::cout << "gaussian splats (radius 4):" << std::endl;
+	{
+		Fluidsim sim(N);
+		std::vector<Splat> dabs;
+		Splat start = { N * 0.1f, N * 0.1f, 4.0f, 0.0f, 1.0f, 0.0f };
+		Splat end = { N * 0.9f, N * 0.9f, 4.0f, 500.0f, 1.0f, 0.0f };
+		while (dabs.size() < 5000) {
+			interpolateStroke(start, end, 0.05f, dabs);
+		}
+		auto t0 = std::chrono::high_resolution_clock::now();
+		sim.splat(dabs.data(), (int)dabs.size());
+		auto t1 = std::chrono::high_resolution_clock::now();
+		double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+		std::cout << "  " << dabs.size() << " splats: " << ms << " ms (" << ms * 1e3 / dabs.size() << " us/splat)" << std::endl;
+		report.setMetric("splat_us", ms * 1e3 / dabs.size());
+	}
+
+	std::cout << "active tiles (small plume in a " << 4 * N << "^2 domain):" << std::endl;
+	{
+		Fluidsim sim(4 * N);
+		int cx = 2 * N, cy = 2 * N;
+		double totalMs = 0.0, activeFraction = 0.0;
+		for (int i = 0; i < steps; i++) {
+			sim.addDensity(cx, cy, 100.0f);
+			sim.addVelocity(cx, cy, 0.0f, 0.5f);
+			auto t0 = std::chrono::high_resolution_clock::now();
+			sim.step();
+			auto t1 = std::chrono::high_resolution_clock::now();
+			totalMs += std::chrono::duration<double, std::milli>(t1 - t0).count();
+			activeFraction += (double)sim.getActiveTileCount() / (sim.getTilesX() * sim.getTilesY());
+		}
+		std::cout << "  " << totalMs / steps << " ms/step with " << activeFraction / steps * 100.0 << " % of tiles active" << std::endl;
+		report.setMetric("step_ms.active_tiles", totalMs / steps);
+	}
+
+	std::cout << "dual resolution (velocity " << N / 4 << "^2, density f x finer, ms/step):" << std::endl;
+	for (int f = 1; f <= 4; f *= 2) {
+		Fluidsim sim(N / 4);
+		sim.setDensityResolution(f);
+		double ms = timeSteps(sim, steps);
+		std::cout << "  f = " << f << ": " << ms << std::endl;
+		report.setMetric("step_ms.density_resolution_" + std::to_string(f), ms);
+	}
+	std::cout << "  uniform " << N << "^2: " << openMs << std::endl;
+
+	std::cout << "resolution governor (budget = half the " << N << "^2 step time):" << std::endl;
+	{
+		Fluidsim sim(N);
+		ResolutionGovernor governor(N, N, (float)openMs * 0.5f);
+		for (int i = 0; i < 6 * steps; i++) {
+			injectSource(sim);
+			auto t0 = std::chrono::high_resolution_clock::now();
+			sim.step();
+			auto t1 = std::chrono::high_resolution_clock::now();
+			if (governor.update(std::chrono::duration<float, std::milli>(t1 - t0).count())) {
+				std::cout << "  step " << i << ": " << governor.getAverageMs() << " ms -> " << governor.getWidth() << "^2" << std::endl;
+				sim.resize(governor.getWidth(), governor.getHeight());
+			}
+		}
+		std::cout << "  settled at " << sim.getWidth() << "^2, " << governor.getAverageMs() << " ms/step" << std::endl;
+	}
+
+	std::cout << "quality governor (budget = half the " << N << "^2 step time):" << std::endl;
+	{
+		Fluidsim sim(N);
+		QualityGovernor quality((float)openMs * 0.5f);
+		double totalMs = 0.0;
+		int over = 0;
+		for (int i = 0; i < 3 * steps; i++) {
+			injectSource(sim);
+			sim.step();
+			totalMs += sim.getLastFrameMs();
+			over += sim.getLastFrameMs() > quality.getBudgetMs();
+			if (quality.update(sim.getLastStageTimes(), sim.getLastFrameMs(), sim.getLastSubsteps())) {
+				sim.setQuality(quality.getQuality());
+			}
+		}
+		std::cout << "  level " << quality.getLevel() << " of " << quality.getLevelCount() - 1 << ", " << totalMs / (3 * steps)
+			<< " ms/step, " << over << " of " << 3 * steps << " steps over budget" << std::endl;
+	}
+
+	std::cout << "moving obstacle update (us/frame):" << std::endl;
+	for (int n = N; n <= 2 * N; n *= 2) {
+		for (float r = N / 16.0f; r <= N / 8.0f; r *= 2.0f) {
+			double us = timeObstacleUpdate(n, r, 200);
+			std::cout << "  N = " << n << ", radius " << r << ": " << us << std::endl;
+			report.setMetric("obstacle_update_us.n" + std::to_string(n) + "_r" + std::to_string((int)r), us);
+		}
+	}
+
+	std::cout << "adaptive quadtree (swaying plume, 2 levels, error vs uniform):" << std::endl;
+	{
+		const int levels = 2;
+		int roots = std::max(N / (AmrFluidsim::BLOCK_SIZE << levels), 1);
+		AmrFluidsim amr(roots, roots, levels);
+		int n = amr.getWidth();
+		int f = 1 << levels;
+		Fluidsim uniform(n);
+		Fluidsim coarse(n / f);
+		double uniformMs = 0.0, coarseMs = 0.0, amrMs = 0.0, amrCells = 0.0;
+		for (int i = 0; i < 3 * steps; i++) {
+			float sway = 0.002f * std::sin(i * 0.1f);
+			for (int k = -2; k <= 2; k++) {
+				uniform.addDensity(n / 2 + k, n / 8, 50.0f);
+				uniform.addVelocity(n / 2 + k, n / 8, sway, 0.01f);
+				amr.addDensity(n / 2 + k, n / 8, 50.0f);
+				amr.addVelocity(n / 2 + k, n / 8, sway, 0.01f);
+			}
+			coarse.addDensity(n / 2 / f + 1, n / 8 / f, 5 * 50.0f / (f * f));
+			coarse.addVelocity(n / 2 / f + 1, n / 8 / f, sway, 0.01f);
+
+			auto t0 = std::chrono::high_resolution_clock::now();
+			uniform.step();
+			auto t1 = std::chrono::high_resolution_clock::now();
+			coarse.step();
+			auto t2 = std::chrono::high_resolution_clock::now();
+			amr.step();
+			auto t3 = std::chrono::high_resolution_clock::now();
+			uniformMs += std::chrono::duration<double, std::milli>(t1 - t0).count();
+			coarseMs += std::chrono::duration<double, std::milli>(t2 - t1).count();
+			amrMs += std::chrono::duration<double, std::milli>(t3 - t2).count();
+			amrCells += amr.getCellCount();
+		}
+
+		std::vector<float> amrDensity((size_t)n * n);
+		amr.readDensity(amrDensity.data());
+		float* ref = uniform.getDensityArray();
+		float* low = coarse.getDensityArray();
+		int nc = n / f;
+		double amrErr = 0.0, coarseErr = 0.0, norm = 0.0, amrMass = 0.0, uniformMass = 0.0;
+		for (int j = 1; j <= n; j++) {
+			for (int i = 1; i <= n; i++) {
+				double r = ref[i + j * (n + 2)];
+				double a = amrDensity[(i - 1) + (j - 1) * n];
+				double c = low[((i - 1) / f + 1) + ((j - 1) / f + 1) * (nc + 2)];
+				amrErr += (r - a) * (r - a);
+				coarseErr += (r - c) * (r - c);
+				norm += r * r;
+				amrMass += a;
+				uniformMass += r;
+			}
+		}
+		int runs = 3 * steps;
+		std::cout << "  uniform " << n << "^2:  " << uniformMs / runs << " ms/step, " << n * n << " cells" << std::endl;
+		std::cout << "  uniform " << nc << "^2:   " << coarseMs / runs << " ms/step, " << nc * nc << " cells, rel. L2 error "
+			<< std::sqrt(coarseErr / norm) << std::endl;
+		std::cout << "  adaptive:      " << amrMs / runs << " ms/step, " << (int)(amrCells / runs) << " cells ("
+			<< amrCells / runs / ((double)n * n) * 100.0 << " %), rel. L2 error " << std::sqrt(amrErr / norm) << std::endl;
+		// neither solver conserves mass exactly (semi-Lagrangian advection)
+		std::cout << "  adaptive density mass vs uniform: " << (amrMass / uniformMass - 1.0) * 100.0 << " %" << std::endl;
+		report.setMetric("step_ms.adaptive_quadtree", amrMs / runs);
+		report.setMetric("adaptive_quadtree.error", std::sqrt(amrErr / norm));
+		report.setMetric("adaptive_quadtree.mass_error", amrMass / uniformMass - 1.0);
+	}
+
+	// at a fixed size: the cavity runs thousands of steps, and errors are
+	// only comparable between runs at the same resolution
+	runValidationSuite(64, report);
+
+	if (jsonPath != nullptr) {
+		if (!report.write(jsonPath)) {
+			std::cerr << "could not write " << jsonPath << std::endl;
+			return 1;
+		}
+		std::cout << "results written to " << jsonPath << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+class Fluidsim;
+
+// Command line shared by the headless modes:
+// --<mode> [N] [steps] [--json <path>] [--csv <path>] [--baseline <path>] [--threshold <percent>]
+struct BenchmarkOptions {
+	// the mode's default size and step count; the rest unset
+	BenchmarkOptions(int N, int steps) : N(N), steps(steps), jsonPath(nullptr), csvPath(nullptr), baselinePath(nullptr), threshold(-1.0f) {}
+
+	int N;
+	int steps;
+	// nullptr unless given
+	const char* jsonPath;
+	const char* csvPath;
+	const char* baselinePath;
+	// allowed slowdown in percent; negative unless given
+	float threshold;
+};
+
+// Fills `options` from argv[2..]; it holds the mode's defaults on entry.
+// Prints the usage line and returns false on bad arguments.
+bool parseBenchmarkOptions(int argc, char** argv, BenchmarkOptions& options);
+
+// Sets the number of OpenMP threads for the following parallel regions and
+// puts the previous number back when it goes out of scope.
+class ScopedThreadCount {
+public:
+	explicit ScopedThreadCount(int threads);
+	~ScopedThreadCount();
+
+private:
+	int previous;
+};
+
+// Density and a sinusoidal swirl over the whole domain, which keeps every
+// tile active so each pass covers all cells.
+void addSwirl(Fluidsim& sim);
+
+// Headless timing runs, started with `--bench` on the command line.
+int runBenchmark(int argc, char** argv);
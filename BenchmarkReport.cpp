@@ -0,0 +1,185 @@
+#include "BenchmarkReport.h"
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+BenchmarkReport::BenchmarkReport() {
+	this->countersAvailable = false;
+}
+
+void BenchmarkReport::set(std::vector<Entry>& entries, const std::string& name, double value) {
+	for (size_t i = 0; i < entries.size(); i++) {
+		if (entries[i].name == name) {
+			entries[i].value = value;
+			return;
+		}
+	}
+	Entry entry = { name, value };
+	entries.push_back(entry);
+}
+
+bool BenchmarkReport::get(const std::vector<Entry>& entries, const std::string& name, double& value) {
+	for (size_t i = 0; i < entries.size(); i++) {
+		if (entries[i].name == name) {
+			value = entries[i].value;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool BenchmarkReport::getInfo(const std::string& key, double& value) const {
+	return get(info, key, value);
+}
+
+bool BenchmarkReport::getMetric(const std::string& name, double& value) const {
+	return get(metrics, name, value);
+}
+
+void BenchmarkReport::setInfo(const std::string& key, double value) {
+	set(info, key, value);
+}
+
+void BenchmarkReport::setMetric(const std::string& name, double value) {
+	set(metrics, name, value);
+}
+
+void BenchmarkReport::setCountersAvailable(bool available, const std::string& error) {
+	this->countersAvailable = available;
+	this->countersError = error;
+}
+
+void BenchmarkReport::setCounters(const std::string& section, double ms, long long calls, const PerfSample& counts) {
+	for (size_t i = 0; i < sections.size(); i++) {
+		if (sections[i].name == section) {
+			sections.erase(sections.begin() + i);
+			break;
+		}
+	}
+	CounterSection entry = { section, ms, calls, counts };
+	sections.push_back(entry);
+}
+
+// Names and messages here are ASCII; only quotes and backslashes need escaping.
+static std::string quote(const std::string& text) {
+	std::string out = "\"";
+	for (size_t i = 0; i < text.size(); i++) {
+		if (text[i] == '"' || text[i] == '\\') out += '\\';
+		out += text[i];
+	}
+	return out + "\"";
+}
+
+static void writeNumber(std::ostream& out, double value) {
+	if (std::isfinite(value)) out << value;
+	else out << "null";
+}
+
+bool BenchmarkReport::write(const char* path) const {
+	std::ofstream out(path);
+	if (!out) return false;
+	out << std::setprecision(9);
+
+	const std::vector<Entry>* groups[2] = { &info, &metrics };
+	const char* groupNames[2] = { "info", "metrics" };
+	out << "{\n";
+	for (int g = 0; g < 2; g++) {
+		out << "  " << quote(groupNames[g]) << ": {";
+		for (size_t i = 0; i < groups[g]->size(); i++) {
+			out << (i ? ",\n    " : "\n    ") << quote((*groups[g])[i].name) << ": ";
+			writeNumber(out, (*groups[g])[i].value);
+		}
+		out << "\n  },\n";
+	}
+
+	out << "  \"counters\": {\n    \"available\": " << (countersAvailable ? "true" : "false")
+		<< ",\n    \"error\": " << quote(countersError) << ",\n    \"sections\": {";
+	for (size_t i = 0; i < sections.size(); i++) {
+		const CounterSection& s = sections[i];
+		out << (i ? ",\n      " : "\n      ") << quote(s.name) << ": { \"ms\": ";
+		writeNumber(out, s.ms);
+		out << ", \"calls\": " << s.calls;
+		for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+			out << ", " << quote(PerfCounters::eventName(e)) << ": ";
+			if (s.counts.value[e] < 0) out << "null";
+			else out << s.counts.value[e];
+		}
+		long long cycles = s.counts.value[PERF_CYCLES];
+		long long instructions = s.counts.value[PERF_INSTRUCTIONS];
+		out << ", \"ipc\": ";
+		if (cycles > 0 && instructions >= 0) out << (double)instructions / cycles;
+		else out << "null";
+		out << " }";
+	}
+	out << "\n    }\n  }\n}\n";
+	return (bool)out;
+}
+
+// Reads a quoted string at `pos`, which must be at the opening quote.
+static bool parseString(const std::string& text, size_t& pos, std::string& out) {
+	if (pos >= text.size() || text[pos] != '"') return false;
+	out.clear();
+	for (pos++; pos < text.size() && text[pos] != '"'; pos++) {
+		if (text[pos] == '\\' && pos + 1 < text.size()) pos++;
+		out += text[pos];
+	}
+	if (pos >= text.size()) return false;
+	pos++;
+	return true;
+}
+
+static void skipSpace(const std::string& text, size_t& pos) {
+	while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\n' || text[pos] == '\r' || text[pos] == '\t')) pos++;
+}
+
+// A flat object of numbers, as write() produces for "info" and "metrics".
+static bool parseNumberObject(const std::string& text, const std::string& key, std::vector<std::pair<std::string, double> >& out) {
+	size_t pos = text.find("\"" + key + "\"");
+	if (pos == std::string::npos) return false;
+	pos = text.find('{', pos);
+	if (pos == std::string::npos) return false;
+	pos++;
+	while (true) {
+		skipSpace(text, pos);
+		if (pos < text.size() && text[pos] == '}') return true;
+		std::string name;
+		if (!parseString(text, pos, name)) return false;
+		skipSpace(text, pos);
+		if (pos >= text.size() || text[pos] != ':') return false;
+		pos++;
+		skipSpace(text, pos);
+		double value;
+		if (text.compare(pos, 4, "null") == 0) {
+			value = std::numeric_limits<double>::quiet_NaN();
+			pos += 4;
+		}
+		else {
+			char* end;
+			value = std::strtod(text.c_str() + pos, &end);
+			if (end == text.c_str() + pos) return false;
+			pos = end - text.c_str();
+		}
+		out.push_back(std::make_pair(name, value));
+		skipSpace(text, pos);
+		if (pos < text.size() && text[pos] == ',') pos++;
+	}
+}
+
+bool BenchmarkReport::read(const char* path) {
+	std::ifstream in(path);
+	if (!in) return false;
+	std::stringstream buffer;
+	buffer << in.rdbuf();
+	std::string text = buffer.str();
+
+	std::vector<std::pair<std::string, double> > infoValues, metricValues;
+	if (!parseNumberObject(text, "info", infoValues) || !parseNumberObject(text, "metrics", metricValues)) return false;
+	info.clear();
+	metrics.clear();
+	for (size_t i = 0; i < infoValues.size(); i++) set(info, infoValues[i].first, infoValues[i].second);
+	for (size_t i = 0; i < metricValues.size(); i++) set(metrics, metricValues[i].first, metricValues[i].second);
+	return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "PerfCounters.h"
+#include <string>
+#include <vector>
+
+// Machine-readable results of the headless modes, written as JSON with
+// `--json <path>`:
+//
+//   { "info": { "n": 256, ... },
+//     "metrics": { "step_ms.open": 12.5, ... },
+//     "counters": { "available": true, "error": "",
+//                   "sections": { "run.open": { "ms": ..., "calls": ...,
+//                                 "cycles": ..., ..., "ipc": ... }, ... } } }
+//
+// Names keep the order they were first set in; setting one again replaces
+// its value. Counters missing on the machine are written as null.
+class BenchmarkReport {
+public:
+	BenchmarkReport();
+
+	void setInfo(const std::string& key, double value);
+	void setMetric(const std::string& name, double value);
+	void setCountersAvailable(bool available, const std::string& error);
+	void setCounters(const std::string& section, double ms, long long calls, const PerfSample& counts);
+
+	bool write(const char* path) const;
+	// Loads "info" and "metrics" from a file written by write(); counter
+	// sections are skipped. False if the file is missing or malformed.
+	bool read(const char* path);
+	// False if the name is not present; null values read as NaN.
+	bool getInfo(const std::string& key, double& value) const;
+	bool getMetric(const std::string& name, double& value) const;
+
+private:
+	struct Entry {
+		std::string name;
+		double value;
+	};
+	struct CounterSection {
+		std::string name;
+		double ms;
+		long long calls;
+		PerfSample counts;
+	};
+
+	std::vector<Entry> info;
+	std::vector<Entry> metrics;
+	std::vector<CounterSection> sections;
+	bool countersAvailable;
+	std::string countersError;
+
+	static void set(std::vector<Entry>& entries, const std::string& name, double value);
+	static bool get(const std::vector<Entry>& entries, const std::string& name, double& value);
+};
@@ -0,0 +1,24 @@
+#include "Brush.h"
+#include <cmath>
+#include <algorithm>
+
+int interpolateStroke(const Splat& from, const Splat& to, float spacing, std::vector<Splat>& out) {
+	float dx = to.x - from.x;
+	float dy = to.y - from.y;
+	float length = std::sqrt(dx * dx + dy * dy);
+	float step = std::max(spacing * std::min(from.radius, to.radius), 0.25f);
+	int count = std::max(1, (int)std::ceil(length / step));
+
+	for (int k = 1; k <= count; k++) {
+		float t = (float)k / count;
+		Splat s;
+		s.x = from.x + t * dx;
+		s.y = from.y + t * dy;
+		s.radius = from.radius + t * (to.radius - from.radius);
+		s.density = to.density / count;
+		s.vx = (from.vx + t * (to.vx - from.vx)) / count;
+		s.vy = (from.vy + t * (to.vy - from.vy)) / count;
+		out.push_back(s);
+	}
+	return count;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vector>
+
+// One Gaussian brush dab. Position and radius are in grid cells (fractional
+// positions are fine); `density` is the total amount spread over the footprint
+// and (vx, vy) is the velocity added at the centre, falling off with the same
+// Gaussian.
+struct Splat {
+	float x;
+	float y;
+	float radius;
+	float density;
+	float vx;
+	float vy;
+};
+
+// Appends dabs from `from` (exclusive) to `to` (inclusive) spaced at most
+// spacing * radius apart, so fast strokes leave a continuous trail. The
+// density of `to` and the interpolated velocity are shared out between the
+// new dabs, so a stroke adds the same mass and momentum however long it is
+// and however many dabs it takes. Returns how many were added.
+int interpolateStroke(const Splat& from, const Splat& to, float spacing, std::vector<Splat>& out);
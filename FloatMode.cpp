@@ -0,0 +1,69 @@
+#include "FloatMode.h"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <pmmintrin.h>
+#include <xmmintrin.h>
+#define FLOAT_MODE_SSE
+#elif defined(__aarch64__) && !defined(_MSC_VER)
+#define FLOAT_MODE_FPCR
+static const uint64_t FPCR_FZ = 1ull << 24;
+#endif
+
+bool canFlushDenormals() {
+#if defined(FLOAT_MODE_SSE) || defined(FLOAT_MODE_FPCR)
+	return true;
+#else
+	return false;
+#endif
+}
+
+void setFlushDenormals(bool enabled) {
+#if defined(FLOAT_MODE_SSE)
+	_MM_SET_FLUSH_ZERO_MODE(enabled ? _MM_FLUSH_ZERO_ON : _MM_FLUSH_ZERO_OFF);
+	_MM_SET_DENORMALS_ZERO_MODE(enabled ? _MM_DENORMALS_ZERO_ON : _MM_DENORMALS_ZERO_OFF);
+#elif defined(FLOAT_MODE_FPCR)
+	uint64_t fpcr;
+	__asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+	fpcr = enabled ? (fpcr | FPCR_FZ) : (fpcr & ~FPCR_FZ);
+	__asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+#else
+	(void)enabled;
+#endif
+}
+
+bool getFlushDenormals() {
+#if defined(FLOAT_MODE_SSE)
+	return _MM_GET_FLUSH_ZERO_MODE() == _MM_FLUSH_ZERO_ON && _MM_GET_DENORMALS_ZERO_MODE() == _MM_DENORMALS_ZERO_ON;
+#elif defined(FLOAT_MODE_FPCR)
+	uint64_t fpcr;
+	__asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+	return (fpcr & FPCR_FZ) != 0;
+#else
+	return false;
+#endif
+}
+
+ScopedFlushDenormals::ScopedFlushDenormals(bool enabled) {
+	this->previous = getFlushDenormals();
+	setFlushDenormals(enabled);
+}
+
+ScopedFlushDenormals::~ScopedFlushDenormals() {
+	setFlushDenormals(previous);
+}
+
+bool isSubnormal(float value) {
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return (bits & 0x7f800000u) == 0 && (bits & 0x007fffffu) != 0;
+}
+
+long long countSubnormals(const float* data, size_t count) {
+	long long n = 0;
+	for (size_t i = 0; i < count; i++) {
+		n += isSubnormal(data[i]);
+	}
+	return n;
+}
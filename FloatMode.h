@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+
+// Flush-to-zero (subnormal results become 0) and denormals-are-zero
+// (subnormal inputs read as 0) for the calling thread: the SSE control
+// register on x86, FPCR.FZ (which does both) on AArch64. Elsewhere
+// setFlushDenormals does nothing and getFlushDenormals returns false.
+bool canFlushDenormals();
+void setFlushDenormals(bool enabled);
+bool getFlushDenormals();
+
+// Sets the mode for the calling thread and puts the previous one back when
+// it goes out of scope.
+class ScopedFlushDenormals {
+public:
+	explicit ScopedFlushDenormals(bool enabled);
+	~ScopedFlushDenormals();
+
+private:
+	bool previous;
+};
+
+// Tested on the bits, so DAZ does not hide them.
+bool isSubnormal(float value);
+long long countSubnormals(const float* data, size_t count);
@@ -2,17 +2,94 @@
 #include <vector>
 #include <cmath>
 #include <algorithm>
+#include <chrono>
+#include <iostream>
+#include "Profiler.h"
+#include "FloatMode.h"
 
-#define IX(x, y) ((x) + (y) * (N+2))
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
-Fluidsim::Fluidsim(int N) {
-	this->N = N;
-	this->size = (N + 2) * (N + 2);
+#define IX(x, y) ((x) + (y) * (Nx+2))
+
+// Visits the interior cells that lie in active tiles, row by row, one
+// contiguous span at a time. With every tile active this is the plain
+// j = 1..Ny, i = 1..Nx sweep.
+#define FOR_ACTIVE_ROWS(j) \
+	for (int j = 1; j <= Ny; j++) \
+		FOR_ROW_SPANS(j)
+#define FOR_ROW_SPANS(j) for (int span_ = spanBegin[(j - 1) / TILE_SIZE]; span_ < spanBegin[(j - 1) / TILE_SIZE + 1]; span_++)
+#define FOR_SPAN_CELLS(i) for (int i = spanStart[span_]; i <= spanEnd[span_]; i++)
+
+// The same spans on the fine density grid: densityRes fine rows and columns per
+// coarse cell.
+#define IXF(x, y) ((x) + (y) * (fineNx+2))
+#define FOR_ACTIVE_FINE_ROWS(fj) \
+	FOR_ACTIVE_ROWS(j_) \
+		for (int fj = (j_ - 1) * densityRes + 1; fj <= j_ * densityRes; fj++)
+#define FOR_SPAN_FINE_CELLS(fi) for (int fi = (spanStart[span_] - 1) * densityRes + 1; fi <= spanEnd[span_] * densityRes; fi++)
+
+Fluidsim::Fluidsim(int N) : Fluidsim(N, N) {
+}
+
+// Square cells sized so the longer side of the domain has length 1.
+Fluidsim::Fluidsim(int Nx, int Ny) : Fluidsim(Nx, Ny, 1.0f / std::max(Nx, Ny), 1.0f / std::max(Nx, Ny)) {
+}
+
+Fluidsim::Fluidsim(int Nx, int Ny, float hx, float hy) : input(INPUT_QUEUE_CAPACITY) {
+	this->Nx = Nx;
+	this->Ny = Ny;
+	this->refNx = Nx;
+	this->refNy = Ny;
+	this->hx = hx;
+	this->hy = hy;
 
 	this->dt = 0.1f;
 	this->diff = 0.0f;
 	this->visc = 0.0f;
 
+	this->cflNumber = 1.0f;
+	this->maxSubsteps = 16;
+	this->lastSubsteps = 0;
+	this->lastSubstepDt = dt;
+	this->lastFrameMs = 0.0f;
+
+	this->quality.diffuseIterations = 20;
+	this->quality.projectIterations = 20;
+	this->quality.diffuseVelocity = true;
+	this->quality.preProjection = true;
+	resetStageTimes();
+
+	this->deterministic = false;
+	this->flushDenormals = true;
+	this->snapThreshold = 1e-20f;
+
+	this->watchdog.enabled = true;
+	this->watchdog.checkpointInterval = 30;
+	this->watchdog.maxDensity = 1e12f;
+	this->watchdog.maxCellsPerStep = 1e4f;
+	this->watchdog.recoverySteps = 200;
+	this->watchdogTripped = false;
+	this->watchdogTrips = 0;
+	this->dtScale = 1.0f;
+	this->cleanSteps = 0;
+	this->stepCount = 0;
+	this->checkpointStep = -1;
+	this->digestLog = nullptr;
+	this->densityRes = 1;
+	this->nextOwner = 1;
+	allocateFields();
+}
+
+Fluidsim::~Fluidsim() {
+	freeFields();
+}
+
+// Allocates every per-cell and per-tile array for the current Nx x Ny, with
+// empty fields, no obstacles and all tiles active.
+void Fluidsim::allocateFields() {
+	this->size = (Nx + 2) * (Ny + 2);
 	this->s = new float[size];
 	this->density = new float[size];
 	this->vx = new float[size];
@@ -20,149 +97,1218 @@ Fluidsim::Fluidsim(int N) {
 	this ->vx0 = new float[size];
 	this->vy0 = new float[size];
 
+	this->fluid = new float[size];
+	this->fluidNbrX = new float[size];
+	this->fluidNbrY = new float[size];
+	this->invFluidNbr = new float[size];
+	this->solidVx = new float[size];
+	this->solidVy = new float[size];
+	this->solidOwner = new int[size];
+	this->visitStamp = new int[size];
+
 	for (int i = 0; i < size; i++) {
 		s[i] = density[i] = vx[i] = vy[i] = vx0[i] = vy0[i] = 0.0f;
+		fluid[i] = 1.0f;
+		solidVx[i] = solidVy[i] = 0.0f;
+		solidOwner[i] = visitStamp[i] = 0;
+	}
+	this->stamp = 0;
+
+	this->fineNx = Nx * densityRes;
+	this->fineNy = Ny * densityRes;
+	this->fineDensity = this->fineS = nullptr;
+	if (densityRes > 1) {
+		int fineSize = (fineNx + 2) * (fineNy + 2);
+		this->fineDensity = new float[fineSize];
+		this->fineS = new float[fineSize];
+		for (int i = 0; i < fineSize; i++) {
+			fineDensity[i] = fineS[i] = 0.0f;
+		}
+	}
+
+	this->tilesX = (Nx + TILE_SIZE - 1) / TILE_SIZE;
+	this->tilesY = (Ny + TILE_SIZE - 1) / TILE_SIZE;
+	this->tileBusy = new unsigned char[tilesX * tilesY];
+	this->tileActive = new unsigned char[tilesX * tilesY];
+	this->spanBegin.assign(tilesY + 1, 0);
+	for (int t = 0; t < tilesX * tilesY; t++) {
+		tileBusy[t] = 1;
 	}
+	updateActiveTiles(0);
+	updateObstacleCoefficients(0, 0, Nx + 1, Ny + 1);
 }
 
-Fluidsim::~Fluidsim() {
+void Fluidsim::freeFields() {
 	delete[] s;
 	delete[] density;
+	delete[] fineDensity;
+	delete[] fineS;
 	delete[] vx;
 	delete[] vy;
 	delete[] vx0;
 	delete[] vy0;
+	delete[] fluid;
+	delete[] fluidNbrX;
+	delete[] fluidNbrY;
+	delete[] invFluidNbr;
+	delete[] solidVx;
+	delete[] solidVy;
+	delete[] solidOwner;
+	delete[] visitStamp;
+	delete[] tileBusy;
+	delete[] tileActive;
+}
+
+void Fluidsim::resize(int newNx, int newNy) {
+	if (newNx == Nx && newNy == Ny) return;
+
+	int oldNx = Nx;
+	int oldNy = Ny;
+	float* oldDensity = density;
+	float* oldVx = vx;
+	float* oldVy = vy;
+	float* oldFine = fineDensity;
+	int* oldOwner = solidOwner;
+	density = vx = vy = fineDensity = nullptr;
+	solidOwner = nullptr;
+	freeFields();
+
+	hx = hx * Nx / newNx;
+	hy = hy * Ny / newNy;
+	Nx = newNx;
+	Ny = newNy;
+	allocateFields();
+
+	resampleConservative(oldDensity, oldNx, oldNy, density, Nx, Ny);
+	resampleConservative(oldVx, oldNx, oldNy, vx, Nx, Ny);
+	resampleConservative(oldVy, oldNx, oldNy, vy, Nx, Ny);
+	if (densityRes > 1) {
+		resampleConservative(oldFine, oldNx * densityRes, oldNy * densityRes, fineDensity, fineNx, fineNy);
+		setFineBoundary(fineDensity);
+	}
+	set_bnd(0, density);
+	set_bnd(1, vx);
+	set_bnd(2, vy);
+
+	// Static obstacles keep the cells whose centres fell in a solid old cell;
+	// moving ones are rasterised again from their pose.
+	for (int j = 1; j <= Ny; j++) {
+		int oj = (int)((j - 0.5f) * oldNy / Ny) + 1;
+		for (int i = 1; i <= Nx; i++) {
+			int oi = (int)((i - 0.5f) * oldNx / Nx) + 1;
+			if (oldOwner[oi + oj * (oldNx + 2)] == STATIC_OWNER) markSolid(IX(i, j), STATIC_OWNER, 0.0f, 0.0f);
+		}
+	}
+	updateObstacleCoefficients(0, 0, Nx + 1, Ny + 1);
+	for (size_t k = 0; k < movingObstacles.size(); k++) {
+		movingObstacles[k].voxelised = false;
+		movingObstacles[k].boundary.clear();
+	}
+	updateMovingObstacles();
+
+	delete[] oldDensity;
+	delete[] oldVx;
+	delete[] oldVy;
+	delete[] oldFine;
+	delete[] oldOwner;
+}
+
+// Area-weighted remap between two grids covering the same domain (interior
+// cells only; both arrays carry a one-cell ghost ring). Done one axis at a
+// time, each destination cell averaging the source cells it overlaps, so the
+// integral of the field is preserved exactly.
+void Fluidsim::resampleConservative(const float* src, int srcNx, int srcNy, float* dst, int dstNx, int dstNy) {
+	std::vector<float> rows((size_t)dstNx * srcNy);
+	float ratioX = (float)srcNx / dstNx;
+	for (int i = 0; i < dstNx; i++) {
+		float x0 = i * ratioX, x1 = (i + 1) * ratioX;
+		for (int j = 0; j < srcNy; j++) {
+			const float* row = src + 1 + (j + 1) * (srcNx + 2);
+			float sum = 0.0f;
+			for (int k = (int)x0; k < srcNx && k < x1; k++) {
+				sum += row[k] * (std::min(x1, (float)(k + 1)) - std::max(x0, (float)k));
+			}
+			rows[i + (size_t)j * dstNx] = sum / ratioX;
+		}
+	}
+
+	float ratioY = (float)srcNy / dstNy;
+	for (int j = 0; j < dstNy; j++) {
+		float y0 = j * ratioY, y1 = (j + 1) * ratioY;
+		for (int i = 0; i < dstNx; i++) {
+			float sum = 0.0f;
+			for (int k = (int)y0; k < srcNy && k < y1; k++) {
+				sum += rows[i + (size_t)k * dstNx] * (std::min(y1, (float)(k + 1)) - std::max(y0, (float)k));
+			}
+			dst[(i + 1) + (j + 1) * (dstNx + 2)] = sum / ratioY;
+		}
+	}
 }
 
 void Fluidsim::addDensity(int x, int y, float amount) {
-	if (x < 1 || x > N || y < 1 || y > N) return;
+	if (x < 1 || x > Nx || y < 1 || y > Ny) return;
 	this->density[IX(x, y)] += amount;
+	if (densityRes > 1) {
+		for (int fj = (y - 1) * densityRes + 1; fj <= y * densityRes; fj++) {
+			for (int fi = (x - 1) * densityRes + 1; fi <= x * densityRes; fi++) {
+				fineDensity[IXF(fi, fj)] += amount;
+			}
+		}
+	}
+	markBusy(x, y);
 }
 
 void Fluidsim::addVelocity(int x, int y, float amountX, float amountY) {
-	if (x < 1 || x > N || y < 1 || y > N) return;
+	if (x < 1 || x > Nx || y < 1 || y > Ny) return;
 	this->vx[IX(x, y)] += amountX;
 	this->vy[IX(x, y)] += amountY;
+	markBusy(x, y);
+}
+
+// The footprint is cut off at `radius` with sigma = radius / 3. Density weights
+// are normalised so the dab adds exactly `density`; velocity uses the raw
+// Gaussian so the centre moves at (vx, vy). Solid cells are masked out.
+void Fluidsim::splat(const Splat* splats, int count) {
+	for (int k = 0; k < count; k++) {
+		const Splat& sp = splats[k];
+		float radius = std::max(sp.radius, 0.5f);
+		float inv2Sigma2 = 4.5f / (radius * radius);
+
+		int x0 = std::max((int)std::floor(sp.x - radius), 1);
+		int x1 = std::min((int)std::ceil(sp.x + radius), Nx);
+		int y0 = std::max((int)std::floor(sp.y - radius), 1);
+		int y1 = std::min((int)std::ceil(sp.y + radius), Ny);
+		if (x0 > x1 || y0 > y1) continue;
+		for (int ty = (y0 - 1) / TILE_SIZE; ty <= (y1 - 1) / TILE_SIZE; ty++) {
+			for (int tx = (x0 - 1) / TILE_SIZE; tx <= (x1 - 1) / TILE_SIZE; tx++) {
+				tileBusy[tx + ty * tilesX] = 1;
+			}
+		}
+
+		int w = x1 - x0 + 1;
+		int h = y1 - y0 + 1;
+		splatWx.resize(w);
+		splatWy.resize(h);
+
+		float sumX = 0.0f, sumY = 0.0f;
+		for (int i = 0; i < w; i++) {
+			float d = (x0 + i) - sp.x;
+			splatWx[i] = std::exp(-d * d * inv2Sigma2);
+			sumX += splatWx[i];
+		}
+		for (int j = 0; j < h; j++) {
+			float d = (y0 + j) - sp.y;
+			splatWy[j] = std::exp(-d * d * inv2Sigma2);
+			sumY += splatWy[j];
+		}
+		float densityScale = sp.density / (sumX * sumY);
+
+		const float* wx = splatWx.data();
+		for (int j = 0; j < h; j++) {
+			int row = IX(x0, y0 + j);
+			float wy = splatWy[j];
+			float dRow = densityScale * wy;
+			float uRow = sp.vx * wy;
+			float vRow = sp.vy * wy;
+			float* dPtr = density + row;
+			float* uPtr = vx + row;
+			float* vPtr = vy + row;
+			const float* fPtr = fluid + row;
+			for (int i = 0; i < w; i++) {
+				float m = fPtr[i] * wx[i];
+				dPtr[i] += dRow * m;
+				uPtr[i] += uRow * m;
+				vPtr[i] += vRow * m;
+			}
+		}
+		if (densityRes > 1) splatFineDensity(sp);
+	}
+}
+
+// The coarse Gaussian resampled on the fine grid; weights are normalised so the
+// dab adds the same mass as on the coarse grid (density times cell area).
+void Fluidsim::splatFineDensity(const Splat& sp) {
+	float f = (float)densityRes;
+	float cx = (sp.x - 0.5f) * f + 0.5f;
+	float cy = (sp.y - 0.5f) * f + 0.5f;
+	float radius = std::max(sp.radius, 0.5f) * f;
+	float inv2Sigma2 = 4.5f / (radius * radius);
+
+	int x0 = std::max((int)std::floor(cx - radius), 1);
+	int x1 = std::min((int)std::ceil(cx + radius), fineNx);
+	int y0 = std::max((int)std::floor(cy - radius), 1);
+	int y1 = std::min((int)std::ceil(cy + radius), fineNy);
+	if (x0 > x1 || y0 > y1) return;
+
+	int w = x1 - x0 + 1;
+	int h = y1 - y0 + 1;
+	splatWx.resize(w);
+	splatWy.resize(h);
+
+	float sumX = 0.0f, sumY = 0.0f;
+	for (int i = 0; i < w; i++) {
+		float d = (x0 + i) - cx;
+		splatWx[i] = std::exp(-d * d * inv2Sigma2);
+		sumX += splatWx[i];
+	}
+	for (int j = 0; j < h; j++) {
+		float d = (y0 + j) - cy;
+		splatWy[j] = std::exp(-d * d * inv2Sigma2);
+		sumY += splatWy[j];
+	}
+	float densityScale = sp.density * f * f / (sumX * sumY);
+
+	for (int j = 0; j < h; j++) {
+		int fj = y0 + j;
+		const float* fRow = fluid + IX(0, (fj + densityRes - 1) / densityRes);
+		float* dPtr = fineDensity + IXF(x0, fj);
+		float dRow = densityScale * splatWy[j];
+		for (int i = 0; i < w; i++) {
+			dPtr[i] += dRow * splatWx[i] * fRow[(x0 + i + densityRes - 1) / densityRes];
+		}
+	}
+}
+
+bool Fluidsim::setDensityResolution(int factor) {
+	if (factor != 1 && factor != 2 && factor != 4) return false;
+	if (factor == densityRes) return true;
+
+	delete[] fineDensity;
+	delete[] fineS;
+	fineDensity = fineS = nullptr;
+	densityRes = factor;
+	fineNx = Nx * factor;
+	fineNy = Ny * factor;
+	if (factor == 1) return true;
+
+	// Each fine cell starts at the value of its coarse cell, so no mass moves.
+	int fineSize = (fineNx + 2) * (fineNy + 2);
+	fineDensity = new float[fineSize];
+	fineS = new float[fineSize];
+	for (int i = 0; i < fineSize; i++) {
+		fineDensity[i] = fineS[i] = 0.0f;
+	}
+	for (int fj = 1; fj <= fineNy; fj++) {
+		for (int fi = 1; fi <= fineNx; fi++) {
+			fineDensity[IXF(fi, fj)] = density[IX((fi + factor - 1) / factor, (fj + factor - 1) / factor)];
+		}
+	}
+	setFineBoundary(fineDensity);
+	return true;
+}
+
+float* Fluidsim::getFineDensityArray() {
+	return (densityRes > 1) ? this->fineDensity : this->density;
 }
 
 float* Fluidsim::getDensityArray() {
 	return this->density;
 }
 
+float* Fluidsim::getFluidMask() {
+	return this->fluid;
+}
+
+float* Fluidsim::getVelocityXArray() {
+	return this->vx;
+}
+
+float* Fluidsim::getVelocityYArray() {
+	return this->vy;
+}
+
+void Fluidsim::setObstacle(int x, int y, bool solid) {
+	if (x < 1 || x > Nx || y < 1 || y > Ny) return;
+	int idx = IX(x, y);
+	if (solid) {
+		if (solidOwner[idx] == 0) markSolid(idx, STATIC_OWNER, 0.0f, 0.0f);
+	}
+	else if (solidOwner[idx] == STATIC_OWNER) {
+		markFluid(idx);
+	}
+	updateObstacleCoefficients(x - 1, y - 1, x + 1, y + 1);
+}
+
+void Fluidsim::addObstacleRect(int x0, int y0, int x1, int y1) {
+	x0 = std::max(x0, 1);
+	y0 = std::max(y0, 1);
+	x1 = std::min(x1, Nx);
+	y1 = std::min(y1, Ny);
+	for (int j = y0; j <= y1; j++) {
+		for (int i = x0; i <= x1; i++) {
+			if (solidOwner[IX(i, j)] == 0) markSolid(IX(i, j), STATIC_OWNER, 0.0f, 0.0f);
+		}
+	}
+	updateObstacleCoefficients(x0 - 1, y0 - 1, x1 + 1, y1 + 1);
+}
+
+void Fluidsim::addObstacleCircle(int cx, int cy, int radius) {
+	for (int j = cy - radius; j <= cy + radius; j++) {
+		for (int i = cx - radius; i <= cx + radius; i++) {
+			if (i < 1 || i > Nx || j < 1 || j > Ny) continue;
+			if ((i - cx) * (i - cx) + (j - cy) * (j - cy) > radius * radius) continue;
+			if (solidOwner[IX(i, j)] == 0) markSolid(IX(i, j), STATIC_OWNER, 0.0f, 0.0f);
+		}
+	}
+	updateObstacleCoefficients(cx - radius - 1, cy - radius - 1, cx + radius + 1, cy + radius + 1);
+}
+
+void Fluidsim::clearObstacles() {
+	for (int i = 0; i < size; i++) {
+		if (solidOwner[i] == STATIC_OWNER) markFluid(i);
+	}
+	updateObstacleCoefficients(0, 0, Nx + 1, Ny + 1);
+}
+
+void Fluidsim::markSolid(int idx, int owner, float wallX, float wallY) {
+	solidOwner[idx] = owner;
+	fluid[idx] = 0.0f;
+	density[idx] = s[idx] = 0.0f;
+	if (densityRes > 1) clearFineCells(idx % (Nx + 2), idx / (Nx + 2));
+	vx[idx] = vx0[idx] = solidVx[idx] = wallX;
+	vy[idx] = vy0[idx] = solidVy[idx] = wallY;
+}
+
+// Uncovered cells start empty and moving with the wall that just left them.
+void Fluidsim::markFluid(int idx) {
+	solidOwner[idx] = 0;
+	fluid[idx] = 1.0f;
+	density[idx] = s[idx] = 0.0f;
+	if (densityRes > 1) clearFineCells(idx % (Nx + 2), idx / (Nx + 2));
+	vx[idx] = vx0[idx] = solidVx[idx];
+	vy[idx] = vy0[idx] = solidVy[idx];
+	solidVx[idx] = solidVy[idx] = 0.0f;
+}
+
+void Fluidsim::addMovingObstacle(MovingObstacle* obstacle) {
+	MovingObstacleState state;
+	state.obstacle = obstacle;
+	state.owner = nextOwner++;
+	state.voxelised = false;
+	state.lastX = state.lastY = state.lastAngle = 0.0f;
+	state.x0 = state.y0 = state.x1 = state.y1 = 0;
+	movingObstacles.push_back(state);
+	updateMovingObstacles();
+}
+
+void Fluidsim::removeMovingObstacle(MovingObstacle* obstacle) {
+	for (size_t k = 0; k < movingObstacles.size(); k++) {
+		MovingObstacleState& state = movingObstacles[k];
+		if (state.obstacle != obstacle) continue;
+
+		if (state.voxelised) {
+			for (int j = state.y0; j <= state.y1; j++) {
+				for (int i = state.x0; i <= state.x1; i++) {
+					if (solidOwner[IX(i, j)] == state.owner) markFluid(IX(i, j));
+				}
+			}
+			updateObstacleCoefficients(state.x0 - 1, state.y0 - 1, state.x1 + 1, state.y1 + 1);
+		}
+		movingObstacles.erase(movingObstacles.begin() + k);
+		return;
+	}
+}
+
+// Re-rasterises each moving obstacle into the mask. For small motions only the
+// band of cells around the previous surface can change occupancy, so the cost is
+// proportional to the perimeter; large jumps fall back to the bounding box.
+void Fluidsim::updateMovingObstacles() {
+	PROFILE_SCOPE("obstacles");
+	for (size_t k = 0; k < movingObstacles.size(); k++) {
+		MovingObstacleState& st = movingObstacles[k];
+		MovingObstacle* ob = st.obstacle;
+
+		// The obstacle lives in reference-grid cells; sx, sy convert to this grid.
+		float sx = (float)Nx / refNx;
+		float sy = (float)Ny / refNy;
+		float radius = ob->getBoundingRadius();
+		float shift = (std::sqrt((ob->getX() - st.lastX) * (ob->getX() - st.lastX) + (ob->getY() - st.lastY) * (ob->getY() - st.lastY))
+			+ std::fabs(ob->getAngle() - st.lastAngle) * radius) * std::max(sx, sy);
+		int band = (int)std::ceil(shift) + 2;
+
+		float cx = (ob->getX() - 0.5f) * sx + 0.5f;
+		float cy = (ob->getY() - 0.5f) * sy + 0.5f;
+		int bx0 = std::max((int)std::floor(cx - radius * sx) - 1, 1);
+		int by0 = std::max((int)std::floor(cy - radius * sy) - 1, 1);
+		int bx1 = std::min((int)std::ceil(cx + radius * sx) + 1, Nx);
+		int by1 = std::min((int)std::ceil(cy + radius * sy) + 1, Ny);
+
+		stamp++;
+		std::vector<int>& candidates = scratchCells;
+		candidates.clear();
+
+		if (!st.voxelised || band > MAX_OBSTACLE_BAND) {
+			int x0 = st.voxelised ? std::min(st.x0, bx0) : bx0;
+			int y0 = st.voxelised ? std::min(st.y0, by0) : by0;
+			int x1 = st.voxelised ? std::max(st.x1, bx1) : bx1;
+			int y1 = st.voxelised ? std::max(st.y1, by1) : by1;
+			for (int j = y0; j <= y1; j++) {
+				for (int i = x0; i <= x1; i++) {
+					visitStamp[IX(i, j)] = stamp;
+					candidates.push_back(IX(i, j));
+				}
+			}
+		}
+		else {
+			for (size_t c = 0; c < st.boundary.size(); c++) {
+				int ci = st.boundary[c] % (Nx + 2);
+				int cj = st.boundary[c] / (Nx + 2);
+				for (int j = std::max(cj - band, 1); j <= std::min(cj + band, Ny); j++) {
+					for (int i = std::max(ci - band, 1); i <= std::min(ci + band, Nx); i++) {
+						if (visitStamp[IX(i, j)] == stamp) continue;
+						visitStamp[IX(i, j)] = stamp;
+						candidates.push_back(IX(i, j));
+					}
+				}
+			}
+		}
+
+		for (size_t c = 0; c < candidates.size(); c++) {
+			int idx = candidates[c];
+			int i = idx % (Nx + 2);
+			int j = idx / (Nx + 2);
+			float rx = (i - 0.5f) / sx + 0.5f;
+			float ry = (j - 0.5f) / sy + 0.5f;
+			bool inside = ob->distance(rx, ry) < 0.0f;
+			bool owned = solidOwner[idx] == st.owner;
+			if (inside && solidOwner[idx] == 0) {
+				float wx, wy;
+				ob->velocityAt(rx, ry, wx, wy);
+				markSolid(idx, st.owner, wx * hx * sx, wy * hy * sy);
+			}
+			else if (!inside && owned) {
+				markFluid(idx);
+			}
+			else continue;
+
+			updateObstacleCoefficients(i - 1, j - 1, i + 1, j + 1);
+			markBusy(i, j);
+		}
+
+		// Only surface cells touch the fluid, so only they need the wall velocity.
+		st.boundary.clear();
+		for (size_t c = 0; c < candidates.size(); c++) {
+			int idx = candidates[c];
+			if (solidOwner[idx] != st.owner) continue;
+			if (fluid[idx - 1] + fluid[idx + 1] + fluid[idx - (Nx + 2)] + fluid[idx + (Nx + 2)] == 0.0f) continue;
+
+			float wx, wy;
+			ob->velocityAt((idx % (Nx + 2) - 0.5f) / sx + 0.5f, (idx / (Nx + 2) - 0.5f) / sy + 0.5f, wx, wy);
+			solidVx[idx] = vx[idx] = vx0[idx] = wx * hx * sx;
+			solidVy[idx] = vy[idx] = vy0[idx] = wy * hy * sy;
+			st.boundary.push_back(idx);
+			if (wx != 0.0f || wy != 0.0f) markBusy(idx % (Nx + 2), idx / (Nx + 2));
+		}
+
+		st.voxelised = true;
+		st.lastX = ob->getX();
+		st.lastY = ob->getY();
+		st.lastAngle = ob->getAngle();
+		st.x0 = bx0;
+		st.y0 = by0;
+		st.x1 = bx1;
+		st.y1 = by1;
+	}
+}
+
+// Recomputes the per-cell stencil coefficients inside the given (inclusive) box.
+// The ghost ring is always fluid: the outer walls are handled by set_bnd.
+void Fluidsim::updateObstacleCoefficients(int x0, int y0, int x1, int y1) {
+	x0 = std::max(x0, 1);
+	y0 = std::max(y0, 1);
+	x1 = std::min(x1, Nx);
+	y1 = std::min(y1, Ny);
+	for (int j = y0; j <= y1; j++) {
+		for (int i = x0; i <= x1; i++) {
+			int idx = IX(i, j);
+			float nx = fluid[IX(i - 1, j)] + fluid[IX(i + 1, j)];
+			float ny = fluid[IX(i, j - 1)] + fluid[IX(i, j + 1)];
+			float n = nx * (hy / hx) + ny * (hx / hy);
+			fluidNbrX[idx] = nx;
+			fluidNbrY[idx] = ny;
+			invFluidNbr[idx] = (n > 0.0f) ? fluid[idx] / n : 0.0f;
+		}
+	}
+}
+
 void Fluidsim::step() {
-	diffuse(1, vx0, vx, visc, dt);
-	diffuse(2, vy0, vy, visc, dt);
+	PROFILE_STAGE("step");
+	auto start = std::chrono::high_resolution_clock::now();
+	ScopedFlushDenormals floatMode(flushDenormals);
+	setWorkerFloatMode();
+	resetStageTimes();
+
+	beginWatchdogStep();
+	drainInput();
+	updateMovingObstacles();
+	// 1 / dtScale substeps, one unless the watchdog has cut the time step
+	int substeps = (int)std::lround(1.0f / dtScale);
+	for (int k = 0; k < substeps && !watchdogTripped; k++) {
+		substep(dt / substeps);
+	}
+	endWatchdogStep();
+	recordStepDigest();
 
-	project(vx0, vy0, vx, vy);
+	auto end = std::chrono::high_resolution_clock::now();
+	lastSubsteps = substeps;
+	lastSubstepDt = dt / substeps;
+	lastFrameMs = std::chrono::duration<float, std::milli>(end - start).count();
+	stageTimes.otherMs = std::max(lastFrameMs - stageTimes.diffuseMs - stageTimes.projectMs - stageTimes.advectMs, 0.0f);
+}
 
-	advect(1, vx, vx0, vy, vy0, dt);
-	advect(2, vy, vy0, vx0, vy0, dt);
+// Checkpoints are taken before the step's input is applied, so a rollback
+// also drops the stroke that caused the blow-up.
+void Fluidsim::beginWatchdogStep() {
+	watchdogTripped = false;
+	if (!watchdog.enabled || stepCount % std::max(watchdog.checkpointInterval, 1) != 0) return;
+	PROFILE_SCOPE("checkpoint");
+	checkpointDensity.assign(density, density + size);
+	checkpointVx.assign(vx, vx + size);
+	checkpointVy.assign(vy, vy + size);
+	if (densityRes > 1) checkpointFine.assign(fineDensity, fineDensity + (fineNx + 2) * (fineNy + 2));
+	else checkpointFine.clear();
+	checkpointStep = stepCount;
+}
 
-	project(vx , vy, vx0, vy0);
+void Fluidsim::endWatchdogStep() {
+	stepCount++;
+	if (!watchdog.enabled) return;
+	if (!watchdogTripped) {
+		if (dtScale < 1.0f && ++cleanSteps >= watchdog.recoverySteps) {
+			dtScale = std::min(dtScale * 2.0f, 1.0f);
+			cleanSteps = 0;
+		}
+		return;
+	}
 
-	diffuse(0, s, density, diff, dt);
-	advect(0, density, s, vx, vy, dt);
+	watchdogTrips++;
+	float oldScale = dtScale;
+	// by value: std::max binds references, which would need a definition
+	dtScale = std::max(dtScale * 0.5f, (float)MIN_DT_SCALE);
+	cleanSteps = 0;
+	bool restored = restoreCheckpoint();
+	std::cerr << "watchdog: step " << stepCount - 1 << ": non-finite or out-of-range values; "
+		<< (restored ? "rolled back to step " + std::to_string(checkpointStep) : std::string("no checkpoint, fields cleared"))
+		<< ", substep length x" << oldScale << " -> x" << dtScale << std::endl;
+	watchdogTripped = false;
+}
 
+// Falls back to empty fields when the checkpoint no longer fits the grid
+// (after resize or setDensityResolution). Scratch arrays may hold the bad
+// values and are cleared; every tile is simulated again on the next step.
+bool Fluidsim::restoreCheckpoint() {
+	int fineSize = (densityRes > 1) ? (fineNx + 2) * (fineNy + 2) : 0;
+	bool valid = checkpointStep >= 0 && (int)checkpointDensity.size() == size && (int)checkpointFine.size() == fineSize;
+	if (valid) {
+		std::copy(checkpointDensity.begin(), checkpointDensity.end(), density);
+		std::copy(checkpointVx.begin(), checkpointVx.end(), vx);
+		std::copy(checkpointVy.begin(), checkpointVy.end(), vy);
+		std::copy(checkpointFine.begin(), checkpointFine.end(), fineDensity);
+	}
+	else {
+		std::fill(density, density + size, 0.0f);
+		std::fill(vx, vx + size, 0.0f);
+		std::fill(vy, vy + size, 0.0f);
+		if (fineSize > 0) std::fill(fineDensity, fineDensity + fineSize, 0.0f);
+	}
+	if (fineSize > 0) std::fill(fineS, fineS + fineSize, 0.0f);
+	// obstacles may have moved since the checkpoint
 	for (int i = 0; i < size; i++) {
-		density[i] *= 0.995f;
+		density[i] *= fluid[i];
+		vx[i] = fluid[i] * vx[i] + (1.0f - fluid[i]) * solidVx[i];
+		vy[i] = fluid[i] * vy[i] + (1.0f - fluid[i]) * solidVy[i];
+		s[i] = vx0[i] = vy0[i] = 0.0f;
+	}
+	for (int t = 0; t < tilesX * tilesY; t++) {
+		tileBusy[t] = 1;
+	}
+	return valid;
+}
+
+// The control register is per thread and OpenMP workers keep theirs
+// between parallel regions, so they are set once per step.
+void Fluidsim::setWorkerFloatMode() {
+#pragma omp parallel
+	::setFlushDenormals(flushDenormals);
+}
+
+SubnormalCounts Fluidsim::getSubnormalCounts() const {
+	SubnormalCounts c;
+	c.density = countSubnormals(density, size);
+	c.vx = countSubnormals(vx, size);
+	c.vy = countSubnormals(vy, size);
+	c.vx0 = countSubnormals(vx0, size);
+	c.vy0 = countSubnormals(vy0, size);
+	return c;
+}
+
+void Fluidsim::recordStepDigest() {
+	if (digestLog == nullptr) return;
+	PROFILE_SCOPE("digest");
+	digestLog->recordStep(size, { { "density", density }, { "vx", vx }, { "vy", vy } });
+}
+
+void Fluidsim::resetStageTimes() {
+	stageTimes.diffuseMs = stageTimes.projectMs = stageTimes.advectMs = stageTimes.otherMs = 0.0f;
+	stageTimes.diffuseSweeps = stageTimes.projectSweeps = 0;
+	stageTimes.densityDiffused = true;
+}
+
+// Advances by `duration` in the fewest equal substeps that keep every
+// backtrace under cflNumber cells, at most maxSubsteps of them. The speed
+// is re-measured after each substep so a decaying stroke lets the remaining
+// substeps grow again.
+void Fluidsim::advance(float duration) {
+	PROFILE_STAGE("advance");
+	auto start = std::chrono::high_resolution_clock::now();
+	ScopedFlushDenormals floatMode(flushDenormals);
+	setWorkerFloatMode();
+	resetStageTimes();
+
+	beginWatchdogStep();
+	drainInput();
+	updateMovingObstacles();
+
+	int substeps = 0;
+	float remaining = duration;
+	while (remaining > 1e-6f * duration && !watchdogTripped) {
+		updateActiveTiles(1);
+		float speed = maxCellSpeed();
+		if (!std::isfinite(speed)) {
+			// NaN or inf already: no substep length helps. The watchdog rolls
+			// back; without it the rest of the duration is dropped.
+			watchdogTripped = watchdog.enabled;
+			break;
+		}
+		// Past maxSubsteps the last substep takes all the remaining time and
+		// exceeds the CFL number; the backtrace is clamped to the domain, so
+		// this smears rather than blows up. Compared as floats so a huge
+		// quotient is never cast to int.
+		float limit = (speed > 0.0f) ? cflNumber * dtScale / speed : remaining;
+		int left = std::max(maxSubsteps - substeps, 1);
+		float wanted = std::ceil(remaining / limit);
+		int n = (wanted < (float)left) ? std::max(1, (int)wanted) : left;
+		float h = remaining / n;
+
+		substep(h);
+		remaining -= h;
+		substeps++;
+		lastSubstepDt = h;
+	}
+	endWatchdogStep();
+	recordStepDigest();
+
+	auto end = std::chrono::high_resolution_clock::now();
+	lastSubsteps = substeps;
+	lastFrameMs = std::chrono::duration<float, std::milli>(end - start).count();
+	stageTimes.otherMs = std::max(lastFrameMs - stageTimes.diffuseMs - stageTimes.projectMs - stageTimes.advectMs, 0.0f);
+}
+
+bool Fluidsim::submit(const InputCommand& command) {
+	return input.push(command);
+}
+
+// Applies everything queued so far. Commands pushed while draining wait for the
+// next step, so a busy producer cannot stall the solver.
+void Fluidsim::drainInput() {
+	PROFILE_SCOPE("input");
+	size_t pending = input.getStats().depth;
+	InputCommand command;
+	for (size_t k = 0; k < pending && input.pop(command); k++) {
+		applyCommand(command);
+	}
+	if (!pendingSplats.empty()) {
+		splat(pendingSplats.data(), (int)pendingSplats.size());
+		pendingSplats.clear();
+	}
+}
+
+// Command positions are in reference-grid cells. Density amounts are scaled
+// by the cell area ratio so a command deposits the same mass at any resolution.
+void Fluidsim::applyCommand(const InputCommand& command) {
+	float sx = (float)Nx / refNx;
+	float sy = (float)Ny / refNy;
+	int x = (int)std::floor((command.x - 0.5f) * sx) + 1;
+	int y = (int)std::floor((command.y - 0.5f) * sy) + 1;
+
+	switch (command.type) {
+	case InputCommand::SPLAT:
+		addDensity(x, y, command.density * sx * sy);
+		addVelocity(x, y, command.vx, command.vy);
+		break;
+	case InputCommand::GAUSSIAN_SPLAT: {
+		Splat dab = { (command.posX - 0.5f) * sx + 0.5f, (command.posY - 0.5f) * sy + 0.5f, command.radius * std::sqrt(sx * sy),
+			command.density * sx * sy, command.vx, command.vy };
+		pendingSplats.push_back(dab);
+		break;
+	}
+	case InputCommand::FORCE:
+		addVelocity(x, y, command.vx, command.vy);
+		break;
+	case InputCommand::EMITTER: {
+		if (command.id < 0 || command.id >= MAX_EMITTERS) break;
+		if ((size_t)command.id >= emitters.size()) {
+			Emitter off = { 0, 0, 0.0f, 0.0f, 0.0f, false };
+			emitters.resize(command.id + 1, off);
+		}
+		Emitter& e = emitters[command.id];
+		e.x = command.x;
+		e.y = command.y;
+		e.density = command.density;
+		e.vx = command.vx;
+		e.vy = command.vy;
+		e.active = command.active;
+		break;
+	}
+	case InputCommand::OBSTACLE_ADD:
+		addMovingObstacle(command.obstacle);
+		break;
+	case InputCommand::OBSTACLE_REMOVE:
+		removeMovingObstacle(command.obstacle);
+		break;
+	case InputCommand::OBSTACLE_POSE:
+		command.obstacle->setPose(command.posX, command.posY, command.angle);
+		command.obstacle->setVelocity(command.vx, command.vy, command.angularVelocity);
+		break;
+	}
+}
+
+// Largest velocity in cells per unit time, reduced per thread then combined.
+// Per tile row, then combined in row order, so the result does not depend
+// on how the rows were shared out.
+float Fluidsim::maxCellSpeed() {
+	PROFILE_SCOPE("max speed");
+	float invHx = 1.0f / hx;
+	float invHy = 1.0f / hy;
+	std::vector<float>& rowMax = scratchRowMax;
+	rowMax.assign(tilesY, 0.0f);
+
+#pragma omp parallel for schedule(static)
+	for (int ty = 0; ty < tilesY; ty++) {
+		float local = 0.0f;
+		for (int j = ty * TILE_SIZE + 1; j <= std::min((ty + 1) * TILE_SIZE, Ny); j++) {
+			FOR_ROW_SPANS(j) {
+				FOR_SPAN_CELLS(i) {
+					local = std::max(local, std::max(std::fabs(vx[IX(i, j)]) * invHx, std::fabs(vy[IX(i, j)]) * invHy));
+				}
+			}
+		}
+		rowMax[ty] = local;
+	}
+
+	float result = 0.0f;
+	for (int ty = 0; ty < tilesY; ty++) {
+		result = std::max(result, rowMax[ty]);
+	}
+	return result;
+}
+
+void Fluidsim::substep(float h) {
+	// emitter rates are per nominal step; positions are in reference-grid cells
+	float share = h / dt;
+	float sx = (float)Nx / refNx;
+	float sy = (float)Ny / refNy;
+	for (size_t k = 0; k < emitters.size(); k++) {
+		const Emitter& e = emitters[k];
+		if (!e.active) continue;
+		int x = (int)std::floor((e.x - 0.5f) * sx) + 1;
+		int y = (int)std::floor((e.y - 0.5f) * sy) + 1;
+		addDensity(x, y, e.density * share * sx * sy);
+		addVelocity(x, y, e.vx * share, e.vy * share);
+	}
+
+	// Dilate by the longest backtrace so advect never samples a skipped tile
+	// that is about to receive flow, plus one tile for the solver stencils.
+	updateActiveTiles(1);
+	// bounded before the cast: no backtrace leaves the domain anyway
+	int backtraceCells = (int)std::ceil(std::min((float)std::max(Nx, Ny), maxCellSpeed() * h));
+	int radius = 1 + (backtraceCells + TILE_SIZE - 1) / TILE_SIZE;
+	if (radius > 1) updateActiveTiles(radius);
+	for (int t = 0; t < tilesX * tilesY; t++) {
+		tileBusy[t] = 0;
+	}
+
+	typedef std::chrono::high_resolution_clock Clock;
+	Clock::time_point t0 = Clock::now();
+	if (quality.diffuseVelocity) {
+		diffuse(1, vx0, vx, visc, h);
+		diffuse(2, vy0, vy, visc, h);
+		stageTimes.diffuseSweeps += 2 * quality.diffuseIterations;
+	}
+	else {
+		std::copy(vx, vx + size, vx0);
+		std::copy(vy, vy + size, vy0);
+	}
+	Clock::time_point t1 = Clock::now();
+	// stage digests are timed with the stage that follows them
+	if (stageDigests()) digestLog->record("diffuse", size, { { "vx0", vx0 }, { "vy0", vy0 } });
+
+	if (quality.preProjection) {
+		project(vx0, vy0, vx, vy);
+		stageTimes.projectSweeps += quality.projectIterations;
+	}
+	Clock::time_point t2 = Clock::now();
+	if (stageDigests() && quality.preProjection) digestLog->record("preproject", size, { { "vx0", vx0 }, { "vy0", vy0 } });
+
+	advect(1, vx, vx0, vx0, vy0, h);
+	advect(2, vy, vy0, vx0, vy0, h);
+	Clock::time_point t3 = Clock::now();
+	if (stageDigests()) digestLog->record("advect", size, { { "vx", vx }, { "vy", vy } });
+
+	project(vx , vy, vx0, vy0);
+	stageTimes.projectSweeps += quality.projectIterations;
+	Clock::time_point t4 = Clock::now();
+	if (stageDigests()) digestLog->record("project", size, { { "vx", vx }, { "vy", vy } });
+
+	if (densityRes > 1) {
+		diffuseFine(fineS, fineDensity, diff, h);
+	}
+	else {
+		diffuse(0, s, density, diff, h);
+	}
+	stageTimes.densityDiffused = densityRes == 1 || diff != 0.0f;
+	if (stageTimes.densityDiffused) stageTimes.diffuseSweeps += quality.diffuseIterations;
+	Clock::time_point t5 = Clock::now();
+
+	if (densityRes > 1) {
+		advectFine(fineDensity, fineS, vx, vy, h);
+	}
+	else {
+		advect(0, density, s, vx, vy, h);
+	}
+	Clock::time_point t6 = Clock::now();
+	if (stageDigests()) {
+		if (densityRes > 1) digestLog->record("density", (size_t)(fineNx + 2) * (fineNy + 2), { { "fine_density", fineDensity } });
+		else digestLog->record("density", size, { { "density", density } });
+	}
+
+	stageTimes.diffuseMs += std::chrono::duration<float, std::milli>((t1 - t0) + (t5 - t4)).count();
+	stageTimes.projectMs += std::chrono::duration<float, std::milli>((t2 - t1) + (t4 - t3)).count();
+	stageTimes.advectMs += std::chrono::duration<float, std::milli>((t3 - t2) + (t6 - t5)).count();
+
+	decayDensity(h);
+}
+
+// 0.995 per nominal step, scaled so substepping decays at the same rate.
+// The same pass snaps values below snapThreshold to zero, runs the watchdog
+// check and records which tiles still hold anything worth simulating.
+void Fluidsim::decayDensity(float h) {
+	PROFILE_SCOPE("decay");
+	float decay = (h == dt) ? 0.995f : std::pow(0.995f, h / dt);
+	if (densityRes > 1) {
+		// decay on the fine grid and keep the coarse density as its cell average
+		float norm = 1.0f / (densityRes * densityRes);
+		FOR_ACTIVE_ROWS(j) {
+			FOR_SPAN_CELLS(i) {
+				float sum = 0.0f;
+				for (int fj = (j - 1) * densityRes + 1; fj <= j * densityRes; fj++) {
+					float* row = fineDensity + IXF((i - 1) * densityRes + 1, fj);
+					for (int k = 0; k < densityRes; k++) {
+						row[k] *= decay;
+						row[k] = (std::fabs(row[k]) < snapThreshold) ? 0.0f : row[k];
+						sum += row[k];
+					}
+				}
+				density[IX(i, j)] = sum * norm;
+			}
+		}
+		decay = 1.0f;
+	}
+	float velEps = VELOCITY_EPSILON * std::min(hx, hy);
+	float snap = snapThreshold;
+	// watchdog limits; NaN fails every comparison, so it trips them too
+	float densityLimit = watchdog.maxDensity;
+	float speedLimit = watchdog.maxCellsPerStep * std::min(hx, hy) / dt;
+	bool healthy = true;
+	FOR_ACTIVE_ROWS(j) {
+		unsigned char* busyRow = tileBusy + ((j - 1) / TILE_SIZE) * tilesX;
+		FOR_SPAN_CELLS(i) {
+			float d = density[IX(i, j)] * decay;
+			density[IX(i, j)] = (std::fabs(d) < snap) ? 0.0f : d;
+			vx[IX(i, j)] = (std::fabs(vx[IX(i, j)]) < snap) ? 0.0f : vx[IX(i, j)];
+			vy[IX(i, j)] = (std::fabs(vy[IX(i, j)]) < snap) ? 0.0f : vy[IX(i, j)];
+			healthy &= (std::fabs(d) <= densityLimit) & (std::fabs(vx[IX(i, j)]) <= speedLimit) & (std::fabs(vy[IX(i, j)]) <= speedLimit);
+			bool busy = density[IX(i, j)] > DENSITY_EPSILON || std::fabs(vx[IX(i, j)]) > velEps || std::fabs(vy[IX(i, j)]) > velEps;
+			busyRow[(i - 1) / TILE_SIZE] |= (unsigned char)busy;
+		}
+	}
+	if (watchdog.enabled && !healthy) watchdogTripped = true;
+	retireQuietTiles();
+}
+
+// Activates every tile within `radius` tiles of a busy one and rebuilds the
+// row spans used by FOR_ACTIVE_ROWS.
+void Fluidsim::updateActiveTiles(int radius) {
+	PROFILE_SCOPE("active tiles");
+	for (int t = 0; t < tilesX * tilesY; t++) {
+		tileActive[t] = 0;
+	}
+	for (int ty = 0; ty < tilesY; ty++) {
+		for (int tx = 0; tx < tilesX; tx++) {
+			if (!tileBusy[tx + ty * tilesX]) continue;
+			for (int y = std::max(ty - radius, 0); y <= std::min(ty + radius, tilesY - 1); y++) {
+				for (int x = std::max(tx - radius, 0); x <= std::min(tx + radius, tilesX - 1); x++) {
+					tileActive[x + y * tilesX] = 1;
+				}
+			}
+		}
+	}
+
+	activeTileCount = 0;
+	spanStart.clear();
+	spanEnd.clear();
+	for (int ty = 0; ty < tilesY; ty++) {
+		spanBegin[ty] = (int)spanStart.size();
+		for (int tx = 0; tx < tilesX; tx++) {
+			if (!tileActive[tx + ty * tilesX]) continue;
+			activeTileCount++;
+
+			int i0 = tx * TILE_SIZE + 1;
+			int i1 = std::min((tx + 1) * TILE_SIZE, Nx);
+			if (!spanEnd.empty() && spanBegin[ty] < (int)spanStart.size() && spanEnd.back() == i0 - 1) {
+				spanEnd.back() = i1;
+			}
+			else {
+				spanStart.push_back(i0);
+				spanEnd.push_back(i1);
+			}
+		}
+	}
+	spanBegin[tilesY] = (int)spanStart.size();
+}
+
+// Tiles that were simulated but came out quiet are cleared to exact zero in
+// every field, so skipping them later reads consistent data.
+void Fluidsim::retireQuietTiles() {
+	for (int ty = 0; ty < tilesY; ty++) {
+		for (int tx = 0; tx < tilesX; tx++) {
+			if (!tileActive[tx + ty * tilesX] || tileBusy[tx + ty * tilesX]) continue;
+
+			for (int j = ty * TILE_SIZE + 1; j <= std::min((ty + 1) * TILE_SIZE, Ny); j++) {
+				for (int i = tx * TILE_SIZE + 1; i <= std::min((tx + 1) * TILE_SIZE, Nx); i++) {
+					int idx = IX(i, j);
+					s[idx] = density[idx] = vx0[idx] = vy0[idx] = 0.0f;
+					vx[idx] = solidVx[idx];
+					vy[idx] = solidVy[idx];
+					if (densityRes > 1) clearFineCells(i, j);
+				}
+			}
+		}
+	}
+}
+
+void Fluidsim::clearFineCells(int x, int y) {
+	for (int fj = (y - 1) * densityRes + 1; fj <= y * densityRes; fj++) {
+		for (int fi = (x - 1) * densityRes + 1; fi <= x * densityRes; fi++) {
+			fineDensity[IXF(fi, fj)] = fineS[IXF(fi, fj)] = 0.0f;
+		}
+	}
+}
+
+void Fluidsim::markBusy(int x, int y) {
+	int tx = std::min(std::max(x - 1, 0), Nx - 1) / TILE_SIZE;
+	int ty = std::min(std::max(y - 1, 0), Ny - 1) / TILE_SIZE;
+	tileBusy[tx + ty * tilesX] = 1;
+}
+
+int Fluidsim::getSweepBandCount() const {
+	if (deterministic) return tilesY;
+#ifdef _OPENMP
+	int threads = omp_get_max_threads();
+#else
+	int threads = 1;
+#endif
+	return (threads > 1) ? std::min(2 * threads, Ny) : 1;
+}
+
+// One Gauss-Seidel sweep: row(j) is called for j = 1..Ny, in bands of
+// consecutive rows. Even bands run in parallel, then odd bands, so no two
+// threads work on adjacent rows; within a band the order is the serial one.
+template <typename RowFn>
+void Fluidsim::sweepRows(const RowFn& row) {
+	int bands = getSweepBandCount();
+	if (bands == 1) {
+		for (int j = 1; j <= Ny; j++) row(j);
+		return;
+	}
+	int rowsPerBand = deterministic ? TILE_SIZE : 0;
+	for (int color = 0; color < 2; color++) {
+#pragma omp parallel for schedule(static)
+		for (int band = color; band < bands; band += 2) {
+			int j0 = deterministic ? band * rowsPerBand + 1 : band * Ny / bands + 1;
+			int j1 = deterministic ? std::min((band + 1) * rowsPerBand, Ny) : (band + 1) * Ny / bands;
+			for (int j = j0; j <= j1; j++) row(j);
+		}
 	}
 }
 
 void Fluidsim::set_bnd(int b, float* x) {
+	PROFILE_SCOPE("set_bnd");
 
-	for (int i = 1; i <= N; i++) {
-		x[IX(i, N + 1)] = (b == 2) ? -x[IX(i, N)] : x[IX(i, N)];
+	for (int i = 1; i <= Nx; i++) {
+		x[IX(i, Ny + 1)] = (b == 2) ? -x[IX(i, Ny)] : x[IX(i, Ny)];
 		x[IX(i, 0)] = (b == 2) ? -x[IX(i, 1)] : x[IX(i, 1)];
 	}
 
-	for (int j = 1; j <= N; j++) {
-		x[IX(N + 1, j)] = (b == 1) ? -x[IX(N, j)] : x[IX(N, j)];
+	for (int j = 1; j <= Ny; j++) {
+		x[IX(Nx + 1, j)] = (b == 1) ? -x[IX(Nx, j)] : x[IX(Nx, j)];
 		x[IX(0, j)] = (b == 1) ? -x[IX(1, j)] : x[IX(1, j)];
 	}
 
 	x[IX(0, 0)] = 0.5f * (x[IX(1, 0)] + x[IX(0, 1)]);
-	x[IX(N + 1, 0)] = 0.5f * (x[IX(N, 0)] + x[IX(N + 1, 1)]);
-	x[IX(0, N + 1)] = 0.5f * (x[IX(1, N + 1)] + x[IX(0, N)]);
-	x[IX(N + 1, N + 1)] = 0.5f * (x[IX(N, N + 1)] + x[IX(N + 1, N)]);
+	x[IX(Nx + 1, 0)] = 0.5f * (x[IX(Nx, 0)] + x[IX(Nx + 1, 1)]);
+	x[IX(0, Ny + 1)] = 0.5f * (x[IX(1, Ny + 1)] + x[IX(0, Ny)]);
+	x[IX(Nx + 1, Ny + 1)] = 0.5f * (x[IX(Nx, Ny + 1)] + x[IX(Nx + 1, Ny)]);
 }
 
 void Fluidsim::advect(int b, float* d, float* d0, float* velocX, float* velocY, float dt) {
-	float i0, i1, j0, j1;
-	float s0, s1, t0, t1;
-	float tmp_x, tmp_y, x, y, Nfloat;
-
-	Nfloat = (float)N;
+	PROFILE_STAGE("advect");
+	// Scalars are renormalised over the fluid corners so they do not leak into
+	// solids; velocities interpolate towards the wall velocity held in solid
+	// cells, so their corner weights need no mask at all.
+	if (b == 0) advectCells<true>(d, d0, velocX, velocY, dt, nullptr);
+	else advectCells<false>(d, d0, velocX, velocY, dt, (b == 2) ? solidVy : solidVx);
+	set_bnd(b, d);
+}
 
-	for (int j = 1; j <= N; j++) {
-		for (int i = 1; i <= N; i++) {
-			tmp_x = (float)i - dt * Nfloat * velocX[IX(i, j)];
-			tmp_y = (float)j - dt * Nfloat * velocY[IX(i, j)];
+template <bool SCALAR>
+void Fluidsim::advectCells(float* d, const float* d0, const float* velocX, const float* velocY, float dt, const float* wall) {
+	float NxFloat = (float)Nx;
+	float NyFloat = (float)Ny;
+	float dtx = dt / hx;
+	float dty = dt / hy;
 
-			if (tmp_x < 0.5f) tmp_x = 0.5f;
-			if (tmp_x > Nfloat + 0.5f) tmp_x = Nfloat + 0.5f;
-			i0 = floor(tmp_x);
-			i1 = i0 + 1.0f;
+#pragma omp parallel for schedule(static)
+	FOR_ACTIVE_ROWS(j) {
+		FOR_SPAN_CELLS(i) {
+			float tmp_x = (float)i - dtx * velocX[IX(i, j)];
+			float tmp_y = (float)j - dty * velocY[IX(i, j)];
 
-			if (tmp_y < 0.5f) tmp_y = 0.5f;
-			if (tmp_y > Nfloat + 0.5f) tmp_y = Nfloat + 0.5f;
-			j0 = floor(tmp_y);
-			j1 = j0 + 1.0f;
+			// the bound first: a NaN speed then clamps to the edge instead of
+			// indexing out of range before the watchdog sees it
+			tmp_x = std::min(std::max(0.5f, tmp_x), NxFloat + 0.5f);
+			tmp_y = std::min(std::max(0.5f, tmp_y), NyFloat + 0.5f);
+			float i0 = floor(tmp_x);
+			float j0 = floor(tmp_y);
 
-			s1 = tmp_x - i0;
-			s0 = 1.0f - s1;
-			t1 = tmp_y - j0;
-			t0 = 1.0f - t1;
+			float s1 = tmp_x - i0;
+			float s0 = 1.0f - s1;
+			float t1 = tmp_y - j0;
+			float t0 = 1.0f - t1;
 
 			int i0i = (int)i0;
-			int i1i = (int)i1;
 			int j0i = (int)j0;
-			int j1j = (int)j1;
+			int c00 = IX(i0i, j0i);
+			int c01 = c00 + (Nx + 2);
+
+			float w00 = s0 * t0;
+			float w01 = s0 * t1;
+			float w10 = s1 * t0;
+			float w11 = s1 * t1;
+			if (SCALAR) {
+				w00 *= fluid[c00];
+				w01 *= fluid[c01];
+				w10 *= fluid[c00 + 1];
+				w11 *= fluid[c01 + 1];
+			}
+			float wsum = std::max(w00 + w01 + w10 + w11, 1e-6f);
 
-			d[IX(i, j)] =
-				s0 * (t0 * d0[IX(i0i, j0i)] + t1 * d0[IX(i0i, j1j)]) +
-				s1 * (t0 * d0[IX(i1i, j0i)] + t1 * d0[IX(i1i, j1j)]);
+			float value = fluid[IX(i, j)] * (w00 * d0[c00] + w01 * d0[c01] + w10 * d0[c00 + 1] + w11 * d0[c01 + 1]) / wsum;
+			if (!SCALAR) value += (1.0f - fluid[IX(i, j)]) * wall[IX(i, j)];
+			d[IX(i, j)] = value;
 		}
 	}
-	set_bnd(b, d);
-
 }
+
 void Fluidsim::diffuse(int b, float* x, float* x0, float diff, float dt) {
-	float a = dt * diff * N * N;
+	PROFILE_STAGE("diffuse");
+	float ax = dt * diff / (hx * hx);
+	float ay = dt * diff / (hy * hy);
 
-	for (int k = 0; k < 20; k++) {
-		for (int j = 1; j <= N; j++) {
-			for (int i = 1; i <= N; i++) {
-				x[IX(i, j)] = (x0[IX(i, j)] + a * (x[IX(i - 1, j)] + x[IX(i + 1, j)] + x[IX(i, j - 1)] + x[IX(i, j + 1)])) / (1 + 4 * a);
-			}
+	// Solid cells hold zero scalars and the wall velocity, so the neighbour sum
+	// needs no mask. Scalars see a zero-flux wall (only fluid neighbours count in
+	// the denominator) while velocities see a no-slip wall moving with the solid.
+	float nbrScale = (b == 0) ? 1.0f : 0.0f;
+	float* wall = (b == 2) ? solidVy : solidVx;
+	float wallScale = 1.0f - nbrScale;
+
+	// The per-cell weight and the source term (weighted x0 plus the wall) are
+	// fixed for the whole solve, so the division and the mask lookups happen
+	// once per call and a sweep reads one stream more than the unmasked one.
+	diffuseWeight.resize(size);
+	diffuseSource.resize(size);
+	float* weight = diffuseWeight.data();
+	float* source = diffuseSource.data();
+#pragma omp parallel for schedule(static)
+	FOR_ACTIVE_ROWS(j) {
+		FOR_SPAN_CELLS(i) {
+			float n = ax * (2.0f + nbrScale * (fluidNbrX[IX(i, j)] - 2.0f)) + ay * (2.0f + nbrScale * (fluidNbrY[IX(i, j)] - 2.0f));
+			weight[IX(i, j)] = fluid[IX(i, j)] / (1 + n);
+			source[IX(i, j)] = weight[IX(i, j)] * x0[IX(i, j)] + wallScale * (1.0f - fluid[IX(i, j)]) * wall[IX(i, j)];
 		}
+	}
+
+	// Only the left neighbour was written earlier in the same row, so it is
+	// added last: the loop-carried chain is one multiply and one add.
+	for (int k = 0; k < quality.diffuseIterations; k++) {
+		sweepRows([&](int j) {
+			FOR_ROW_SPANS(j) {
+				FOR_SPAN_CELLS(i) {
+					float w = weight[IX(i, j)];
+					float rest = source[IX(i, j)] + w * (ax * x[IX(i + 1, j)] + ay * (x[IX(i, j - 1)] + x[IX(i, j + 1)]));
+					x[IX(i, j)] = (w * ax) * x[IX(i - 1, j)] + rest;
+				}
+			}
+		});
 		set_bnd(b, x);
 	}
 }
 
+// Pressure is solved scaled by the cell area hx*hy, so square cells reduce to
+// the familiar (div + sum of neighbours) / 4 update.
 void Fluidsim::project(float* velocX, float* velocY, float* p, float* div) {
-	for (int j = 1; j <= N; j++) {
-		for (int i = 1; i <= N; i++) {
-			div[IX(i, j)] = -0.5f * ((velocX[IX(i + 1, j)] - velocX[IX(i - 1, j)]) + (velocY[IX(i, j + 1)] - velocY[IX(i, j - 1)])) / N;
+	PROFILE_STAGE("project");
+	float wx = hy / hx;
+	float wy = hx / hy;
+
+#pragma omp parallel for schedule(static)
+	FOR_ACTIVE_ROWS(j) {
+		FOR_SPAN_CELLS(i) {
+			div[IX(i, j)] = -0.5f * fluid[IX(i, j)] * ((velocX[IX(i + 1, j)] - velocX[IX(i - 1, j)]) * hy + (velocY[IX(i, j + 1)] - velocY[IX(i, j - 1)]) * hx);
 			p[IX(i, j)] = 0;
 		}
 	}
 	set_bnd(0, div);
 	set_bnd(0, p);
 
-	for (int k = 0; k < 20; k++) {
-		for (int j = 1; j <= N; j++) {
-			for (int i = 1; i <= N; i++) {
-				p[IX(i, j)] = (div[IX(i, j)] + p[IX(i - 1, j)] + p[IX(i + 1, j)] + p[IX(i, j - 1)] + p[IX(i, j + 1)]) / 4;
-
+	// Solid pressure stays zero, so only fluid neighbours contribute to the sum;
+	// invFluidNbr turns the usual /4 into a Neumann condition at obstacle faces.
+	for (int k = 0; k < quality.projectIterations; k++) {
+		sweepRows([&](int j) {
+			FOR_ROW_SPANS(j) {
+				FOR_SPAN_CELLS(i) {
+					// left neighbour last, as in diffuse
+					float w = invFluidNbr[IX(i, j)];
+					float rest = (div[IX(i, j)] + wx * p[IX(i + 1, j)] + wy * (p[IX(i, j - 1)] + p[IX(i, j + 1)])) * w;
+					p[IX(i, j)] = (wx * w) * p[IX(i - 1, j)] + rest;
+				}
 			}
-			
-		}
+		});
 		set_bnd(0, p);
 	}
-	for (int j = 1; j <= N; j++) {
-		for (int i = 1; i <= N; i++) {
-			velocX[IX(i, j)] -= 0.5f * (p[IX(i + 1, j)] - p[IX(i - 1, j)]) * N;
-			velocY[IX(i, j)] -= 0.5f * (p[IX(i, j+1)] - p[IX(i , j-1)]) * N;
+	// A solid neighbour mirrors the centre pressure, so the wall velocity held in
+	// solid cells is the only flux through an obstacle face.
+#pragma omp parallel for schedule(static)
+	FOR_ACTIVE_ROWS(j) {
+		FOR_SPAN_CELLS(i) {
+			float pc = p[IX(i, j)];
+			float pl = p[IX(i - 1, j)] + (1.0f - fluid[IX(i - 1, j)]) * pc;
+			float pr = p[IX(i + 1, j)] + (1.0f - fluid[IX(i + 1, j)]) * pc;
+			float pd = p[IX(i, j - 1)] + (1.0f - fluid[IX(i, j - 1)]) * pc;
+			float pu = p[IX(i, j + 1)] + (1.0f - fluid[IX(i, j + 1)]) * pc;
+			float f = fluid[IX(i, j)];
+			velocX[IX(i, j)] = f * (velocX[IX(i, j)] - 0.5f * (pr - pl) / hx) + (1.0f - f) * solidVx[IX(i, j)];
+			velocY[IX(i, j)] = f * (velocY[IX(i, j)] - 0.5f * (pu - pd) / hy) + (1.0f - f) * solidVy[IX(i, j)];
 
 		}
 	}
@@ -171,3 +1317,112 @@ void Fluidsim::project(float* velocX, float* velocY, float* p, float* div) {
 
 }
 
+void Fluidsim::setFineBoundary(float* x) {
+	PROFILE_SCOPE("set_bnd fine");
+	for (int i = 1; i <= fineNx; i++) {
+		x[IXF(i, fineNy + 1)] = x[IXF(i, fineNy)];
+		x[IXF(i, 0)] = x[IXF(i, 1)];
+	}
+	for (int j = 1; j <= fineNy; j++) {
+		x[IXF(fineNx + 1, j)] = x[IXF(fineNx, j)];
+		x[IXF(0, j)] = x[IXF(1, j)];
+	}
+	x[IXF(0, 0)] = 0.5f * (x[IXF(1, 0)] + x[IXF(0, 1)]);
+	x[IXF(fineNx + 1, 0)] = 0.5f * (x[IXF(fineNx, 0)] + x[IXF(fineNx + 1, 1)]);
+	x[IXF(0, fineNy + 1)] = 0.5f * (x[IXF(1, fineNy + 1)] + x[IXF(0, fineNy)]);
+	x[IXF(fineNx + 1, fineNy + 1)] = 0.5f * (x[IXF(fineNx, fineNy + 1)] + x[IXF(fineNx + 1, fineNy)]);
+}
+
+// Zero-flux walls at obstacles as in diffuse(), with the fluid mask read from
+// the coarse cell that contains each fine cell.
+void Fluidsim::diffuseFine(float* x, float* x0, float diff, float dt) {
+	PROFILE_STAGE("diffuse fine");
+	if (diff == 0.0f) {
+		FOR_ACTIVE_FINE_ROWS(fj) {
+			FOR_SPAN_FINE_CELLS(fi) {
+				x[IXF(fi, fj)] = x0[IXF(fi, fj)];
+			}
+		}
+		setFineBoundary(x);
+		return;
+	}
+
+	float fhx = hx / densityRes;
+	float fhy = hy / densityRes;
+	float ax = dt * diff / (fhx * fhx);
+	float ay = dt * diff / (fhy * fhy);
+	int r = densityRes;
+
+	for (int k = 0; k < quality.diffuseIterations; k++) {
+		FOR_ACTIVE_FINE_ROWS(fj) {
+			int cj = (fj + r - 1) / r;
+			int cjDown = (fj + r - 2) / r;
+			int cjUp = (fj + r) / r;
+			FOR_SPAN_FINE_CELLS(fi) {
+				int ci = (fi + r - 1) / r;
+				float nx = fluid[IX((fi + r - 2) / r, cj)] + fluid[IX((fi + r) / r, cj)];
+				float ny = fluid[IX(ci, cjDown)] + fluid[IX(ci, cjUp)];
+				x[IXF(fi, fj)] = fluid[IX(ci, cj)] * (x0[IXF(fi, fj)] + ax * (x[IXF(fi - 1, fj)] + x[IXF(fi + 1, fj)]) + ay * (x[IXF(fi, fj - 1)] + x[IXF(fi, fj + 1)]))
+					/ (1 + ax * nx + ay * ny);
+			}
+		}
+		setFineBoundary(x);
+	}
+}
+
+// Semi-Lagrangian density transport on the fine grid. The backtrace uses the
+// coarse velocity interpolated bilinearly to the fine cell centre; positions are
+// worked out in coarse cell units, where the centre of fine cell fi lies at
+// (fi - 0.5) / densityRes + 0.5.
+void Fluidsim::advectFine(float* d, float* d0, float* velocX, float* velocY, float dt) {
+	PROFILE_STAGE("advect fine");
+	int r = densityRes;
+	float f = (float)r;
+	float invF = 1.0f / f;
+	float dtx = dt / hx;
+	float dty = dt / hy;
+	float NxFloat = (float)Nx;
+	float NyFloat = (float)Ny;
+	float fineNxFloat = (float)fineNx;
+	float fineNyFloat = (float)fineNy;
+
+	FOR_ACTIVE_FINE_ROWS(fj) {
+		float cy = (fj - 0.5f) * invF + 0.5f;
+		int vj = (int)cy;
+		float vt = cy - vj;
+		FOR_SPAN_FINE_CELLS(fi) {
+			float cx = (fi - 0.5f) * invF + 0.5f;
+			int vi = (int)cx;
+			float vs = cx - vi;
+
+			float u = (1.0f - vt) * ((1.0f - vs) * velocX[IX(vi, vj)] + vs * velocX[IX(vi + 1, vj)])
+				+ vt * ((1.0f - vs) * velocX[IX(vi, vj + 1)] + vs * velocX[IX(vi + 1, vj + 1)]);
+			float v = (1.0f - vt) * ((1.0f - vs) * velocY[IX(vi, vj)] + vs * velocY[IX(vi + 1, vj)])
+				+ vt * ((1.0f - vs) * velocY[IX(vi, vj + 1)] + vs * velocY[IX(vi + 1, vj + 1)]);
+
+			// NaN-safe order, as in advect()
+			float x = std::min(std::max(0.5f, cx - dtx * u), NxFloat + 0.5f);
+			float y = std::min(std::max(0.5f, cy - dty * v), NyFloat + 0.5f);
+			float tmp_x = std::min(std::max((x - 0.5f) * f + 0.5f, 0.5f), fineNxFloat + 0.5f);
+			float tmp_y = std::min(std::max((y - 0.5f) * f + 0.5f, 0.5f), fineNyFloat + 0.5f);
+
+			int i0 = (int)tmp_x;
+			int j0 = (int)tmp_y;
+			float s1 = tmp_x - i0, s0 = 1.0f - s1;
+			float t1 = tmp_y - j0, t0 = 1.0f - t1;
+
+			int ci0 = (i0 + r - 1) / r, ci1 = (i0 + r) / r;
+			int cj0 = (j0 + r - 1) / r, cj1 = (j0 + r) / r;
+			float w00 = s0 * t0 * fluid[IX(ci0, cj0)];
+			float w01 = s0 * t1 * fluid[IX(ci0, cj1)];
+			float w10 = s1 * t0 * fluid[IX(ci1, cj0)];
+			float w11 = s1 * t1 * fluid[IX(ci1, cj1)];
+			float wsum = std::max(w00 + w01 + w10 + w11, 1e-6f);
+
+			d[IXF(fi, fj)] = fluid[IX((fi + r - 1) / r, (fj + r - 1) / r)] *
+				(w00 * d0[IXF(i0, j0)] + w01 * d0[IXF(i0, j0 + 1)] +
+				 w10 * d0[IXF(i0 + 1, j0)] + w11 * d0[IXF(i0 + 1, j0 + 1)]) / wsum;
+		}
+	}
+	setFineBoundary(d);
+}
@@ -1,35 +1,339 @@
 #pragma once
 
+#include <vector>
+#include "Obstacle.h"
+#include "InputQueue.h"
+#include "Brush.h"
+#include "StateDigest.h"
+
+// Solver effort per step. The default is the full-quality configuration;
+// a QualityGovernor lowers it under load.
+struct SolverQuality {
+	int diffuseIterations;
+	int projectIterations;
+	// optional stages: velocity diffusion and the projection before advection
+	bool diffuseVelocity;
+	bool preProjection;
+};
+
+// Wall time of the last step()/advance() by stage, summed over its substeps,
+// with the number of Gauss-Seidel sweeps each solver stage ran.
+struct StageTimes {
+	float diffuseMs;
+	float projectMs;
+	float advectMs;
+	float otherMs;
+	int diffuseSweeps;
+	int projectSweeps;
+	// false when density diffusion was skipped (fine density without diffusion)
+	bool densityDiffused;
+};
+
+// Blow-up watchdog. The decay pass at the end of every substep also checks
+// each active cell; a non-finite value, density above maxDensity or a speed
+// above maxCellsPerStep (backtrace cells per nominal step) trips it. The
+// fields are then rolled back to the last checkpoint, the substeps are made
+// half as long (down to 1/16) and the event is logged to stderr. The
+// default limits (1e12, 1e4 cells) are far beyond anything a stroke produces
+// and only catch values that are already diverging.
+struct WatchdogSettings {
+	bool enabled;
+	// steps between in-memory checkpoints of density and velocity
+	int checkpointInterval;
+	float maxDensity;
+	float maxCellsPerStep;
+	// trip-free steps after which a cut substep length is doubled again
+	int recoverySteps;
+};
+
+// Subnormal floats per field, from Fluidsim::getSubnormalCounts().
+struct SubnormalCounts {
+	long long density;
+	long long vx;
+	long long vy;
+	long long vx0;
+	long long vy0;
+};
+
 class Fluidsim {
 public:
 	Fluidsim(int N);
+	Fluidsim(int Nx, int Ny);
+	// hx, hy: cell width and height in domain units
+	Fluidsim(int Nx, int Ny, float hx, float hy);
 	~Fluidsim();
 
 	void step();
+	// Advances by `duration` using CFL-limited substeps instead of one fixed dt.
+	void advance(float duration);
 	void addDensity(int x, int y, float amount);
 	void addVelocity(int x, int y, float amountX, float amountY);
+	// Gaussian footprints, written row by row from separable weights.
+	void splat(const Splat* splats, int count);
+
+	void setObstacle(int x, int y, bool solid);
+	void addObstacleRect(int x0, int y0, int x1, int y1);
+	void addObstacleCircle(int cx, int cy, int radius);
+	void clearObstacles();
+
+	// The simulation keeps a pointer; the caller owns the obstacle and moves it
+	// with setPose/setVelocity. Occupancy is refreshed at the start of step().
+	void addMovingObstacle(MovingObstacle* obstacle);
+	void removeMovingObstacle(MovingObstacle* obstacle);
+	void updateMovingObstacles();
+
+	// Digests of the fields after every step (and solver stage, if the log
+	// asks for them) go to `log`; the caller owns it. nullptr turns it off.
+	void setDigestLog(DigestLog* log) { this->digestLog = log; }
+
+	// Thread-safe injection: commands are queued and applied in one batch at
+	// the start of the next step()/advance(). Returns false if the queue is full.
+	bool submit(const InputCommand& command);
+	InputQueueStats getInputStats() const { return input.getStats(); }
+	// EMITTER commands with an id outside [0, MAX_EMITTERS) are dropped.
+	static const int MAX_EMITTERS = 256;
+
+	// Only tiles of TILE_SIZE x TILE_SIZE cells near density or motion are
+	// simulated; the rest are known to be exactly zero.
+	static const int TILE_SIZE = 16;
+	int getTilesX() const { return tilesX; }
+	int getTilesY() const { return tilesY; }
+	int getActiveTileCount() const { return activeTileCount; }
+	const unsigned char* getActiveTiles() const { return tileActive; }
+
+	// Carries density on a grid `factor` (1, 2 or 4) times finer than the
+	// velocity, advected by interpolated coarse velocity. The current density is
+	// carried over. getDensityArray then holds per-cell averages of the fine field.
+	// Returns false, changing nothing, for any other factor.
+	bool setDensityResolution(int factor);
+	int getDensityResolution() const { return densityRes; }
+	// (Nx*f + 2) x (Ny*f + 2) with the ghost ring; the coarse array when f is 1.
+	float* getFineDensityArray();
 
 	float* getDensityArray();
+	float* getFluidMask();
+	float* getVelocityXArray();
+	float* getVelocityYArray();
+	// Changes the grid to newNx x newNy cells over the same domain. Density and
+	// velocity are remapped conservatively, static obstacles resampled and
+	// moving obstacles rasterised again. Queued commands, emitters and moving
+	// obstacles stay in the cells of the grid the simulation was created with
+	// (the reference grid), so producers need not follow resolution changes.
+	void resize(int newNx, int newNy);
+	int getReferenceWidth() const { return refNx; }
+	int getReferenceHeight() const { return refNy; }
+
+	float getTimeStep() const { return dt; }
+	void setTimeStep(float dt) { this->dt = dt; }
+	// Kinematic viscosity and density diffusivity in domain units^2 per unit
+	// time; both are 0 by default.
+	void setViscosity(float visc) { this->visc = visc; }
+	void setDiffusion(float diff) { this->diff = diff; }
+	// Maximum backtrace length, in cells, allowed per substep by advance().
+	void setCflNumber(float cfl) { this->cflNumber = cfl; }
+	// Upper bound on advance()'s substeps per call (default 16), so a fast
+	// stroke costs at most that many substeps instead of stalling the frame.
+	void setMaxSubsteps(int substeps) { this->maxSubsteps = substeps; }
+	int getMaxSubsteps() const { return maxSubsteps; }
+	int getLastSubsteps() const { return lastSubsteps; }
+	float getLastSubstepDt() const { return lastSubstepDt; }
+	float getLastFrameMs() const { return lastFrameMs; }
+	// Solver loops run on OpenMP threads. Gauss-Seidel sweeps go band by band,
+	// even bands in parallel and then odd ones: by default two bands per
+	// thread (one, the serial sweep, on a single thread), so results depend
+	// on the thread count. Deterministic mode fixes one band per tile row and
+	// keeps every reduction in row order, so results are bitwise identical
+	// for any thread count. A colour pass then has at most tilesY / 2 bands
+	// (4 at 128^2, 8 at 256^2), so sweeps stop scaling beyond that many
+	// threads. On one thread it costs 0-3 % per step at 128^2 and 256^2;
+	// --bench prints both modes at 1 to 8 threads for the machine at hand.
+	// Flush-to-zero and denormals-are-zero (FloatMode.h) during step() and
+	// advance(), on the calling thread (restored afterwards) and the OpenMP
+	// workers; on by default. The decay pass also snaps density and velocity
+	// below the snap threshold (default 1e-20) to exact zero, so nothing
+	// decays into the subnormal range where FTZ is not available; 0 turns it off.
+	void setFlushDenormals(bool enabled) { this->flushDenormals = enabled; }
+	bool getFlushDenormals() const { return flushDenormals; }
+	void setSnapThreshold(float threshold) { this->snapThreshold = threshold; }
+	float getSnapThreshold() const { return snapThreshold; }
+	// Scans every field, for diagnostics rather than every frame.
+	SubnormalCounts getSubnormalCounts() const;
+
+	void setWatchdog(const WatchdogSettings& settings) { this->watchdog = settings; }
+	const WatchdogSettings& getWatchdog() const { return watchdog; }
+	int getWatchdogTrips() const { return watchdogTrips; }
+	// substep length relative to the nominal one, below 1 after a trip
+	float getWatchdogDtScale() const { return dtScale; }
+	long long getStepCount() const { return stepCount; }
+
+	void setDeterministic(bool deterministic) { this->deterministic = deterministic; }
+	bool isDeterministic() const { return deterministic; }
+	int getSweepBandCount() const;
+	void setQuality(const SolverQuality& quality) { this->quality = quality; }
+	const SolverQuality& getQuality() const { return quality; }
+	const StageTimes& getLastStageTimes() const { return stageTimes; }
+	int getWidth() const { return Nx; }
+	int getHeight() const { return Ny; }
 
 private:
-	int N;
+	// --selftest feeds identical inputs to the private kernels and the reference.
+	friend class SelfTest;
+
+	int Nx;
+	int Ny;
 	int size;
+	int refNx;
+	int refNy;
+
+	float hx;
+	float hy;
 
 	float dt;
 	float diff;
 	float visc;
 
+	float cflNumber;
+	int maxSubsteps;
+	int lastSubsteps;
+	float lastSubstepDt;
+	float lastFrameMs;
+
+	SolverQuality quality;
+	StageTimes stageTimes;
+	bool deterministic;
+	bool flushDenormals;
+	float snapThreshold;
+	void setWorkerFloatMode();
+
+	static constexpr float MIN_DT_SCALE = 1.0f / 16.0f;
+	WatchdogSettings watchdog;
+	bool watchdogTripped;
+	int watchdogTrips;
+	float dtScale;
+	int cleanSteps;
+	long long stepCount;
+	long long checkpointStep;
+	std::vector<float> checkpointDensity;
+	std::vector<float> checkpointVx;
+	std::vector<float> checkpointVy;
+	std::vector<float> checkpointFine;
+	void beginWatchdogStep();
+	void endWatchdogStep();
+	bool restoreCheckpoint();
+	DigestLog* digestLog;
+	bool stageDigests() const { return digestLog != nullptr && digestLog->getStageDigests(); }
+	void recordStepDigest();
+	void resetStageTimes();
+
 	float* s;
 	float* density;
 
+	// fine density and its scratch copy, allocated only when densityRes > 1
+	int densityRes;
+	int fineNx;
+	int fineNy;
+	float* fineDensity;
+	float* fineS;
+
 	float* vx;
 	float* vy;
 
 	float* vx0;
 	float* vy0;
 
+	// 1 for fluid, 0 for solid. Kernels multiply by it instead of branching.
+	float* fluid;
+	// number of fluid neighbours along x and y, and the inverse of the
+	// spacing-weighted total used by the pressure solve (0 for enclosed cells)
+	float* fluidNbrX;
+	float* fluidNbrY;
+	float* invFluidNbr;
+	// velocity of the wall occupying a solid cell (zero for static obstacles)
+	float* solidVx;
+	float* solidVy;
+	// 0 = fluid, STATIC_OWNER = static obstacle, otherwise a moving obstacle id
+	int* solidOwner;
+
+	static const int STATIC_OWNER = -1;
+	static const int MAX_OBSTACLE_BAND = 8;
+
+	struct MovingObstacleState {
+		MovingObstacle* obstacle;
+		int owner;
+		bool voxelised;
+		float lastX, lastY, lastAngle;
+		int x0, y0, x1, y1;
+		std::vector<int> boundary;
+	};
+	std::vector<MovingObstacleState> movingObstacles;
+	int nextOwner;
+
+	struct Emitter {
+		int x, y;
+		float density;
+		float vx, vy;
+		bool active;
+	};
+	std::vector<Emitter> emitters;
+
+	static const int INPUT_QUEUE_CAPACITY = 4096;
+	InputQueue input;
+	std::vector<Splat> pendingSplats;
+	std::vector<float> splatWx;
+	std::vector<float> splatWy;
+
+	// below these (density, and velocity in cells per unit time) a cell counts as quiet
+	static constexpr float DENSITY_EPSILON = 1e-4f;
+	static constexpr float VELOCITY_EPSILON = 1e-3f;
+
+	int tilesX;
+	int tilesY;
+	unsigned char* tileBusy;
+	unsigned char* tileActive;
+	int activeTileCount;
+	// per tile row, the range [spanBegin[ty], spanBegin[ty+1]) of [spanStart, spanEnd] runs
+	std::vector<int> spanBegin;
+	std::vector<int> spanStart;
+	std::vector<int> spanEnd;
+
+	void allocateFields();
+	void freeFields();
+	static void resampleConservative(const float* src, int srcNx, int srcNy, float* dst, int dstNx, int dstNy);
+
+	void updateActiveTiles(int radius);
+	void retireQuietTiles();
+	void markBusy(int x, int y);
+
+	int* visitStamp;
+	int stamp;
+	std::vector<int> scratchCells;
+
+	void markSolid(int idx, int owner, float wallX, float wallY);
+	void markFluid(int idx);
+	void updateObstacleCoefficients(int x0, int y0, int x1, int y1);
+
+	void drainInput();
+	void applyCommand(const InputCommand& command);
+	float maxCellSpeed();
+	std::vector<float> scratchRowMax;
+	template <typename RowFn>
+	void sweepRows(const RowFn& row);
+	void substep(float h);
+	void decayDensity(float h);
+
+	// per-cell weight and source term of the current diffuse() call
+	std::vector<float> diffuseWeight;
+	std::vector<float> diffuseSource;
 	void diffuse(int b, float* x, float* x0, float diff, float dt);
 	void project(float* velocX, float* velocY, float* p, float* div);
 	void advect(int b, float* d, float* d0, float* velocX, float* velocY, float dt);
+	template <bool SCALAR>
+	void advectCells(float* d, const float* d0, const float* velocX, const float* velocY, float dt, const float* wall);
 	void set_bnd(int b, float* x);
-};
\ No newline at end of file
+
+	void clearFineCells(int x, int y);
+	void splatFineDensity(const Splat& sp);
+	void diffuseFine(float* x, float* x0, float diff, float dt);
+	void advectFine(float* d, float* d0, float* velocX, float* velocY, float dt);
+	void setFineBoundary(float* x);
+};
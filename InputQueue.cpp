@@ -0,0 +1,75 @@
+#include "InputQueue.h"
+
+InputQueue::InputQueue(size_t capacity) {
+	size_t rounded = 2;
+	while (rounded < capacity) rounded *= 2;
+
+	this->slots = new Slot[rounded];
+	this->mask = rounded - 1;
+	for (size_t i = 0; i < rounded; i++) {
+		slots[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	this->enqueuePos.store(0);
+	this->dequeuePos.store(0);
+	this->maxDepth.store(0);
+	this->dropped.store(0);
+	this->processed.store(0);
+}
+
+InputQueue::~InputQueue() {
+	delete[] slots;
+}
+
+bool InputQueue::push(const InputCommand& command) {
+	size_t pos = enqueuePos.load(std::memory_order_relaxed);
+	Slot* slot;
+	for (;;) {
+		slot = &slots[pos & mask];
+		size_t seq = slot->sequence.load(std::memory_order_acquire);
+		ptrdiff_t diff = (ptrdiff_t)seq - (ptrdiff_t)pos;
+		if (diff == 0) {
+			if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+		}
+		else if (diff < 0) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		else {
+			pos = enqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	slot->command = command;
+	slot->sequence.store(pos + 1, std::memory_order_release);
+
+	size_t depth = pos + 1 - dequeuePos.load(std::memory_order_relaxed);
+	size_t seen = maxDepth.load(std::memory_order_relaxed);
+	while (depth > seen && !maxDepth.compare_exchange_weak(seen, depth, std::memory_order_relaxed)) {
+	}
+	return true;
+}
+
+bool InputQueue::pop(InputCommand& command) {
+	size_t pos = dequeuePos.load(std::memory_order_relaxed);
+	Slot* slot = &slots[pos & mask];
+	size_t seq = slot->sequence.load(std::memory_order_acquire);
+	if ((ptrdiff_t)seq - (ptrdiff_t)(pos + 1) != 0) return false;
+
+	command = slot->command;
+	slot->sequence.store(pos + mask + 1, std::memory_order_release);
+	dequeuePos.store(pos + 1, std::memory_order_relaxed);
+	processed.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+InputQueueStats InputQueue::getStats() const {
+	InputQueueStats stats;
+	size_t head = enqueuePos.load(std::memory_order_relaxed);
+	size_t tail = dequeuePos.load(std::memory_order_relaxed);
+	stats.depth = (head > tail) ? head - tail : 0;
+	stats.maxDepth = maxDepth.load(std::memory_order_relaxed);
+	stats.dropped = dropped.load(std::memory_order_relaxed);
+	stats.processed = processed.load(std::memory_order_relaxed);
+	return stats;
+}
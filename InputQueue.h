@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+class MovingObstacle;
+
+// An injection request from the UI (or any other producer) to the solver.
+struct InputCommand {
+	enum Type {
+		SPLAT,             // density + velocity at a cell
+		GAUSSIAN_SPLAT,    // brush dab at (posX, posY) with `radius`
+		FORCE,             // velocity only
+		EMITTER,           // create/update/disable persistent source `id` (< Fluidsim::MAX_EMITTERS)
+		OBSTACLE_ADD,
+		OBSTACLE_REMOVE,
+		OBSTACLE_POSE      // pose and rigid velocity of `obstacle`
+	};
+
+	Type type;
+	int x;
+	int y;
+	float density;
+	float vx;
+	float vy;
+	float radius;
+
+	int id;
+	bool active;
+
+	MovingObstacle* obstacle;
+	float angle;
+	float posX;
+	float posY;
+	float angularVelocity;
+};
+
+struct InputQueueStats {
+	size_t depth;
+	size_t maxDepth;
+	size_t dropped;
+	size_t processed;
+};
+
+// Bounded multi-producer/single-consumer queue (sequence-numbered ring, no
+// locks). Producers never block: push fails and is counted when the ring is full.
+class InputQueue {
+public:
+	InputQueue(size_t capacity);
+	~InputQueue();
+
+	bool push(const InputCommand& command);
+	// Consumer side only.
+	bool pop(InputCommand& command);
+
+	InputQueueStats getStats() const;
+
+private:
+	struct Slot {
+		std::atomic<size_t> sequence;
+		InputCommand command;
+	};
+
+	Slot* slots;
+	size_t mask;
+
+	std::atomic<size_t> enqueuePos;
+	std::atomic<size_t> dequeuePos;
+
+	std::atomic<size_t> maxDepth;
+	std::atomic<size_t> dropped;
+	std::atomic<size_t> processed;
+};
@@ -0,0 +1,308 @@
+#include "MacFluidsim.h"
+#include <cmath>
+#include <algorithm>
+
+#define IX(x, y) ((x) + (y) * (Nx+2))
+
+MacFluidsim::MacFluidsim(int N) : MacFluidsim(N, N) {
+}
+
+MacFluidsim::MacFluidsim(int Nx, int Ny) : MacFluidsim(Nx, Ny, 1.0f / std::max(Nx, Ny), 1.0f / std::max(Nx, Ny)) {
+}
+
+MacFluidsim::MacFluidsim(int Nx, int Ny, float hx, float hy) {
+	this->Nx = Nx;
+	this->Ny = Ny;
+	this->hx = hx;
+	this->hy = hy;
+	this->size = (Nx + 2) * (Ny + 2);
+
+	this->dt = 0.1f;
+	this->diff = 0.0f;
+	this->visc = 0.0f;
+
+	this->s = new float[size];
+	this->density = new float[size];
+	this->u = new float[size];
+	this->v = new float[size];
+	this->u0 = new float[size];
+	this->v0 = new float[size];
+	this->p = new float[size];
+	this->div = new float[size];
+	this->centreVx = new float[size];
+	this->centreVy = new float[size];
+
+	for (int i = 0; i < size; i++) {
+		s[i] = density[i] = u[i] = v[i] = u0[i] = v0[i] = 0.0f;
+		p[i] = div[i] = centreVx[i] = centreVy[i] = 0.0f;
+	}
+}
+
+MacFluidsim::~MacFluidsim() {
+	delete[] s;
+	delete[] density;
+	delete[] u;
+	delete[] v;
+	delete[] u0;
+	delete[] v0;
+	delete[] p;
+	delete[] div;
+	delete[] centreVx;
+	delete[] centreVy;
+}
+
+void MacFluidsim::addDensity(int x, int y, float amount) {
+	if (x < 1 || x > Nx || y < 1 || y > Ny) return;
+	this->density[IX(x, y)] += amount;
+}
+
+// Splits the impulse between the two faces of the cell, so a uniform push
+// gives every face (and every cell centre) the same velocity.
+void MacFluidsim::addVelocity(int x, int y, float amountX, float amountY) {
+	if (x < 1 || x > Nx || y < 1 || y > Ny) return;
+	if (x > 1) this->u[IX(x - 1, y)] += 0.5f * amountX;
+	if (x < Nx) this->u[IX(x, y)] += 0.5f * amountX;
+	if (y > 1) this->v[IX(x, y - 1)] += 0.5f * amountY;
+	if (y < Ny) this->v[IX(x, y)] += 0.5f * amountY;
+}
+
+float* MacFluidsim::getDensityArray() {
+	return this->density;
+}
+
+float* MacFluidsim::getVelocityXArray() {
+	return this->centreVx;
+}
+
+float* MacFluidsim::getVelocityYArray() {
+	return this->centreVy;
+}
+
+void MacFluidsim::step() {
+	diffuseU(u0, u, visc, dt);
+	diffuseV(v0, v, visc, dt);
+
+	advectVelocity(dt);
+
+	project();
+
+	diffuseScalar(s, density, diff, dt);
+	advectScalar(density, s, dt);
+
+	for (int i = 0; i < size; i++) {
+		density[i] *= 0.995f;
+	}
+
+	updateCentredVelocity();
+}
+
+// Faces on the outer walls carry no flow; the ghost rows alongside them copy
+// their neighbour (free slip).
+void MacFluidsim::set_bnd_u(float* x) {
+	for (int j = 1; j <= Ny; j++) {
+		x[IX(0, j)] = 0.0f;
+		x[IX(Nx, j)] = 0.0f;
+	}
+	for (int i = 0; i <= Nx; i++) {
+		x[IX(i, 0)] = x[IX(i, 1)];
+		x[IX(i, Ny + 1)] = x[IX(i, Ny)];
+	}
+}
+
+void MacFluidsim::set_bnd_v(float* x) {
+	for (int i = 1; i <= Nx; i++) {
+		x[IX(i, 0)] = 0.0f;
+		x[IX(i, Ny)] = 0.0f;
+	}
+	for (int j = 0; j <= Ny; j++) {
+		x[IX(0, j)] = x[IX(1, j)];
+		x[IX(Nx + 1, j)] = x[IX(Nx, j)];
+	}
+}
+
+void MacFluidsim::set_bnd(float* x) {
+	for (int i = 1; i <= Nx; i++) {
+		x[IX(i, 0)] = x[IX(i, 1)];
+		x[IX(i, Ny + 1)] = x[IX(i, Ny)];
+	}
+	for (int j = 1; j <= Ny; j++) {
+		x[IX(0, j)] = x[IX(1, j)];
+		x[IX(Nx + 1, j)] = x[IX(Nx, j)];
+	}
+
+	x[IX(0, 0)] = 0.5f * (x[IX(1, 0)] + x[IX(0, 1)]);
+	x[IX(Nx + 1, 0)] = 0.5f * (x[IX(Nx, 0)] + x[IX(Nx + 1, 1)]);
+	x[IX(0, Ny + 1)] = 0.5f * (x[IX(1, Ny + 1)] + x[IX(0, Ny)]);
+	x[IX(Nx + 1, Ny + 1)] = 0.5f * (x[IX(Nx, Ny + 1)] + x[IX(Nx + 1, Ny)]);
+}
+
+// Bilinear samples in cell coordinates (cell i has its centre at x = i).
+// u(i, j) sits at (i + 0.5, j) and v(i, j) at (i, j + 0.5).
+float MacFluidsim::sampleU(float* field, float x, float y) {
+	float fx = std::min(std::max(x - 0.5f, 0.0f), (float)Nx);
+	float fy = std::min(std::max(y, 1.0f), (float)Ny);
+	int i0 = std::min((int)fx, Nx - 1);
+	int j0 = std::min((int)fy, Ny - 1);
+	float s1 = fx - i0, s0 = 1.0f - s1;
+	float t1 = fy - j0, t0 = 1.0f - t1;
+	return s0 * (t0 * field[IX(i0, j0)] + t1 * field[IX(i0, j0 + 1)]) +
+		s1 * (t0 * field[IX(i0 + 1, j0)] + t1 * field[IX(i0 + 1, j0 + 1)]);
+}
+
+float MacFluidsim::sampleV(float* field, float x, float y) {
+	float fx = std::min(std::max(x, 1.0f), (float)Nx);
+	float fy = std::min(std::max(y - 0.5f, 0.0f), (float)Ny);
+	int i0 = std::min((int)fx, Nx - 1);
+	int j0 = std::min((int)fy, Ny - 1);
+	float s1 = fx - i0, s0 = 1.0f - s1;
+	float t1 = fy - j0, t0 = 1.0f - t1;
+	return s0 * (t0 * field[IX(i0, j0)] + t1 * field[IX(i0, j0 + 1)]) +
+		s1 * (t0 * field[IX(i0 + 1, j0)] + t1 * field[IX(i0 + 1, j0 + 1)]);
+}
+
+void MacFluidsim::diffuseU(float* x, float* x0, float diff, float dt) {
+	float ax = dt * diff / (hx * hx);
+	float ay = dt * diff / (hy * hy);
+
+	set_bnd_u(x0);
+	for (int i = 0; i < size; i++) {
+		x[i] = x0[i];
+	}
+	for (int k = 0; k < 20; k++) {
+		for (int j = 1; j <= Ny; j++) {
+			for (int i = 1; i < Nx; i++) {
+				x[IX(i, j)] = (x0[IX(i, j)] + ax * (x[IX(i - 1, j)] + x[IX(i + 1, j)]) + ay * (x[IX(i, j - 1)] + x[IX(i, j + 1)])) / (1 + 2 * ax + 2 * ay);
+			}
+		}
+		set_bnd_u(x);
+	}
+}
+
+void MacFluidsim::diffuseV(float* x, float* x0, float diff, float dt) {
+	float ax = dt * diff / (hx * hx);
+	float ay = dt * diff / (hy * hy);
+
+	set_bnd_v(x0);
+	for (int i = 0; i < size; i++) {
+		x[i] = x0[i];
+	}
+	for (int k = 0; k < 20; k++) {
+		for (int j = 1; j < Ny; j++) {
+			for (int i = 1; i <= Nx; i++) {
+				x[IX(i, j)] = (x0[IX(i, j)] + ax * (x[IX(i - 1, j)] + x[IX(i + 1, j)]) + ay * (x[IX(i, j - 1)] + x[IX(i, j + 1)])) / (1 + 2 * ax + 2 * ay);
+			}
+		}
+		set_bnd_v(x);
+	}
+}
+
+void MacFluidsim::diffuseScalar(float* x, float* x0, float diff, float dt) {
+	float ax = dt * diff / (hx * hx);
+	float ay = dt * diff / (hy * hy);
+
+	for (int k = 0; k < 20; k++) {
+		for (int j = 1; j <= Ny; j++) {
+			for (int i = 1; i <= Nx; i++) {
+				x[IX(i, j)] = (x0[IX(i, j)] + ax * (x[IX(i - 1, j)] + x[IX(i + 1, j)]) + ay * (x[IX(i, j - 1)] + x[IX(i, j + 1)])) / (1 + 2 * ax + 2 * ay);
+			}
+		}
+		set_bnd(x);
+	}
+}
+
+// Advects u0/v0 into u/v. Each face backtraces from its own position using the
+// other component averaged from the four surrounding faces.
+void MacFluidsim::advectVelocity(float dt) {
+	float dtx = dt / hx;
+	float dty = dt / hy;
+
+	for (int j = 1; j <= Ny; j++) {
+		for (int i = 1; i < Nx; i++) {
+			float uf = u0[IX(i, j)];
+			float vf = 0.25f * (v0[IX(i, j - 1)] + v0[IX(i, j)] + v0[IX(i + 1, j - 1)] + v0[IX(i + 1, j)]);
+			u[IX(i, j)] = sampleU(u0, (float)i + 0.5f - dtx * uf, (float)j - dty * vf);
+		}
+	}
+	for (int j = 1; j < Ny; j++) {
+		for (int i = 1; i <= Nx; i++) {
+			float uf = 0.25f * (u0[IX(i - 1, j)] + u0[IX(i, j)] + u0[IX(i - 1, j + 1)] + u0[IX(i, j + 1)]);
+			float vf = v0[IX(i, j)];
+			v[IX(i, j)] = sampleV(v0, (float)i - dtx * uf, (float)j + 0.5f - dty * vf);
+		}
+	}
+	set_bnd_u(u);
+	set_bnd_v(v);
+}
+
+void MacFluidsim::advectScalar(float* d, float* d0, float dt) {
+	float dtx = dt / hx;
+	float dty = dt / hy;
+	float NxFloat = (float)Nx;
+	float NyFloat = (float)Ny;
+
+	for (int j = 1; j <= Ny; j++) {
+		for (int i = 1; i <= Nx; i++) {
+			float uc = 0.5f * (u[IX(i - 1, j)] + u[IX(i, j)]);
+			float vc = 0.5f * (v[IX(i, j - 1)] + v[IX(i, j)]);
+
+			float x = std::min(std::max((float)i - dtx * uc, 0.5f), NxFloat + 0.5f);
+			float y = std::min(std::max((float)j - dty * vc, 0.5f), NyFloat + 0.5f);
+			int i0 = (int)std::floor(x);
+			int j0 = (int)std::floor(y);
+			float s1 = x - i0, s0 = 1.0f - s1;
+			float t1 = y - j0, t0 = 1.0f - t1;
+
+			d[IX(i, j)] =
+				s0 * (t0 * d0[IX(i0, j0)] + t1 * d0[IX(i0, j0 + 1)]) +
+				s1 * (t0 * d0[IX(i0 + 1, j0)] + t1 * d0[IX(i0 + 1, j0 + 1)]);
+		}
+	}
+	set_bnd(d);
+}
+
+// Compact divergence from the faces of each cell, and a pressure gradient
+// taken across each face. Pressure is scaled by the cell area as in Fluidsim.
+void MacFluidsim::project() {
+	float wx = hy / hx;
+	float wy = hx / hy;
+
+	for (int j = 1; j <= Ny; j++) {
+		for (int i = 1; i <= Nx; i++) {
+			div[IX(i, j)] = -((u[IX(i, j)] - u[IX(i - 1, j)]) * hy + (v[IX(i, j)] - v[IX(i, j - 1)]) * hx);
+			p[IX(i, j)] = 0;
+		}
+	}
+	set_bnd(div);
+	set_bnd(p);
+
+	for (int k = 0; k < 20; k++) {
+		for (int j = 1; j <= Ny; j++) {
+			for (int i = 1; i <= Nx; i++) {
+				p[IX(i, j)] = (div[IX(i, j)] + wx * (p[IX(i - 1, j)] + p[IX(i + 1, j)]) + wy * (p[IX(i, j - 1)] + p[IX(i, j + 1)])) / (2 * wx + 2 * wy);
+			}
+		}
+		set_bnd(p);
+	}
+
+	for (int j = 1; j <= Ny; j++) {
+		for (int i = 1; i < Nx; i++) {
+			u[IX(i, j)] -= (p[IX(i + 1, j)] - p[IX(i, j)]) / hx;
+		}
+	}
+	for (int j = 1; j < Ny; j++) {
+		for (int i = 1; i <= Nx; i++) {
+			v[IX(i, j)] -= (p[IX(i, j + 1)] - p[IX(i, j)]) / hy;
+		}
+	}
+	set_bnd_u(u);
+	set_bnd_v(v);
+}
+
+void MacFluidsim::updateCentredVelocity() {
+	for (int j = 1; j <= Ny; j++) {
+		for (int i = 1; i <= Nx; i++) {
+			centreVx[IX(i, j)] = 0.5f * (u[IX(i - 1, j)] + u[IX(i, j)]);
+			centreVy[IX(i, j)] = 0.5f * (v[IX(i, j - 1)] + v[IX(i, j)]);
+		}
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+// Staggered (MAC) variant of Fluidsim with the same public API. Velocities live
+// on cell faces: u(i, j) on the face between cells i and i+1, v(i, j) on the
+// face between cells j and j+1. The pressure solve uses the compact 5-point
+// stencil, which has no checkerboard null space. Interior obstacles are not
+// supported by this variant.
+class MacFluidsim {
+public:
+	MacFluidsim(int N);
+	MacFluidsim(int Nx, int Ny);
+	MacFluidsim(int Nx, int Ny, float hx, float hy);
+	~MacFluidsim();
+
+	void step();
+	void addDensity(int x, int y, float amount);
+	void addVelocity(int x, int y, float amountX, float amountY);
+
+	float* getDensityArray();
+	// cell-centred velocity, refreshed at the end of every step
+	float* getVelocityXArray();
+	float* getVelocityYArray();
+	float getTimeStep() const { return dt; }
+	int getWidth() const { return Nx; }
+	int getHeight() const { return Ny; }
+
+private:
+	int Nx;
+	int Ny;
+	int size;
+
+	float hx;
+	float hy;
+
+	float dt;
+	float diff;
+	float visc;
+
+	float* s;
+	float* density;
+
+	float* u;
+	float* v;
+	float* u0;
+	float* v0;
+
+	float* p;
+	float* div;
+
+	float* centreVx;
+	float* centreVy;
+
+	float sampleU(float* field, float x, float y);
+	float sampleV(float* field, float x, float y);
+
+	void diffuseU(float* x, float* x0, float diff, float dt);
+	void diffuseV(float* x, float* x0, float diff, float dt);
+	void diffuseScalar(float* x, float* x0, float diff, float dt);
+	void advectVelocity(float dt);
+	void advectScalar(float* d, float* d0, float dt);
+	void project();
+	void updateCentredVelocity();
+
+	void set_bnd_u(float* x);
+	void set_bnd_v(float* x);
+	void set_bnd(float* x);
+};
@@ -0,0 +1,80 @@
+#include "Obstacle.h"
+#include <cmath>
+#include <algorithm>
+
+MovingObstacle::MovingObstacle(std::function<float(float, float)> sdf, float boundingRadius) {
+	this->sdf = sdf;
+	this->boundingRadius = boundingRadius;
+	this->x = this->y = this->angle = 0.0f;
+	this->vx = this->vy = this->angularVelocity = 0.0f;
+}
+
+MovingObstacle::MovingObstacle(const std::vector<Point>& polygon) {
+	float r = 0.0f;
+	for (const Point& p : polygon) {
+		r = std::max(r, std::sqrt(p.x * p.x + p.y * p.y));
+	}
+
+	// Distance to the nearest edge, negated when an even-odd crossing test puts the point inside.
+	this->sdf = [polygon](float px, float py) {
+		float best = 1e30f;
+		bool inside = false;
+		size_t n = polygon.size();
+		for (size_t i = 0, j = n - 1; i < n; j = i++) {
+			const Point& a = polygon[i];
+			const Point& b = polygon[j];
+
+			float ex = b.x - a.x, ey = b.y - a.y;
+			float wx = px - a.x, wy = py - a.y;
+			float len2 = ex * ex + ey * ey;
+			float t = (len2 > 0.0f) ? std::min(std::max((wx * ex + wy * ey) / len2, 0.0f), 1.0f) : 0.0f;
+			float dx = wx - t * ex, dy = wy - t * ey;
+			best = std::min(best, dx * dx + dy * dy);
+
+			if ((a.y > py) != (b.y > py) && px < a.x + (py - a.y) * ex / ey) {
+				inside = !inside;
+			}
+		}
+		float d = std::sqrt(best);
+		return inside ? -d : d;
+	};
+	this->boundingRadius = r;
+	this->x = this->y = this->angle = 0.0f;
+	this->vx = this->vy = this->angularVelocity = 0.0f;
+}
+
+MovingObstacle MovingObstacle::circle(float radius) {
+	return MovingObstacle([radius](float px, float py) {
+		return std::sqrt(px * px + py * py) - radius;
+	}, radius);
+}
+
+MovingObstacle MovingObstacle::box(float halfWidth, float halfHeight) {
+	return MovingObstacle(std::vector<Point>{
+		{ -halfWidth, -halfHeight }, { halfWidth, -halfHeight },
+		{ halfWidth, halfHeight }, { -halfWidth, halfHeight }
+	});
+}
+
+void MovingObstacle::setPose(float x, float y, float angle) {
+	this->x = x;
+	this->y = y;
+	this->angle = angle;
+}
+
+void MovingObstacle::setVelocity(float vx, float vy, float angularVelocity) {
+	this->vx = vx;
+	this->vy = vy;
+	this->angularVelocity = angularVelocity;
+}
+
+float MovingObstacle::distance(float px, float py) const {
+	float c = std::cos(angle), s = std::sin(angle);
+	float dx = px - x, dy = py - y;
+	return sdf(c * dx + s * dy, -s * dx + c * dy);
+}
+
+void MovingObstacle::velocityAt(float px, float py, float& outVx, float& outVy) const {
+	outVx = vx - angularVelocity * (py - y);
+	outVy = vy + angularVelocity * (px - x);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+// A rigid solid that can be moved around the grid between steps. The shape is
+// given in local coordinates (grid cells, origin at the pose position) either
+// as a signed distance function (negative inside) or as a closed polygon.
+class MovingObstacle {
+public:
+	struct Point {
+		float x;
+		float y;
+	};
+
+	MovingObstacle(std::function<float(float, float)> sdf, float boundingRadius);
+	MovingObstacle(const std::vector<Point>& polygon);
+
+	static MovingObstacle circle(float radius);
+	static MovingObstacle box(float halfWidth, float halfHeight);
+
+	void setPose(float x, float y, float angle);
+	// Linear velocity in cells per unit time, angular velocity in radians per unit time.
+	void setVelocity(float vx, float vy, float angularVelocity);
+
+	float distance(float px, float py) const;
+	void velocityAt(float px, float py, float& outVx, float& outVy) const;
+
+	float getX() const { return x; }
+	float getY() const { return y; }
+	float getAngle() const { return angle; }
+	float getBoundingRadius() const { return boundingRadius; }
+
+private:
+	std::function<float(float, float)> sdf;
+	float boundingRadius;
+
+	float x;
+	float y;
+	float angle;
+	float vx;
+	float vy;
+	float angularVelocity;
+};
@@ -0,0 +1,135 @@
+#include "PerfCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+PerfSample PerfSample::since(const PerfSample& start) const {
+	PerfSample d;
+	for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+		d.value[e] = (value[e] < 0 || start.value[e] < 0) ? -1 : value[e] - start.value[e];
+	}
+	return d;
+}
+
+void PerfSample::add(const PerfSample& other) {
+	for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+		value[e] = (value[e] < 0 || other.value[e] < 0) ? -1 : value[e] + other.value[e];
+	}
+}
+
+PerfSample PerfSample::zero() {
+	PerfSample s;
+	for (int e = 0; e < PERF_EVENT_COUNT; e++) s.value[e] = 0;
+	return s;
+}
+
+const char* PerfCounters::eventName(int e) {
+	static const char* names[PERF_EVENT_COUNT] = {
+		"cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses", "branch_misses"
+	};
+	return names[e];
+}
+
+PerfCounters::PerfCounters() {
+	for (int e = 0; e < PERF_EVENT_COUNT; e++) fds[e] = -1;
+	this->openCount = 0;
+}
+
+PerfCounters::~PerfCounters() {
+	close();
+}
+
+#ifdef __linux__
+
+static unsigned long long cacheMissConfig(int cache) {
+	return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+bool PerfCounters::open() {
+	close();
+	const unsigned int types[PERF_EVENT_COUNT] = {
+		PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+		PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE
+	};
+	const unsigned long long configs[PERF_EVENT_COUNT] = {
+		PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, cacheMissConfig(PERF_COUNT_HW_CACHE_L1D),
+		PERF_COUNT_HW_CACHE_MISSES, cacheMissConfig(PERF_COUNT_HW_CACHE_DTLB), PERF_COUNT_HW_BRANCH_MISSES
+	};
+
+	int firstErrno = 0;
+	for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+		perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = types[e];
+		attr.config = configs[e];
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		// user space only: allowed up to perf_event_paranoid = 2
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fds[e] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		if (fds[e] < 0) {
+			if (firstErrno == 0) firstErrno = errno;
+			continue;
+		}
+		openCount++;
+	}
+
+	if (openCount == 0) {
+		error = std::string("perf_event_open: ") + std::strerror(firstErrno);
+		if (firstErrno == EACCES || firstErrno == EPERM) {
+			error += " (see /proc/sys/kernel/perf_event_paranoid)";
+		}
+		return false;
+	}
+	for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+		if (fds[e] >= 0) ioctl(fds[e], PERF_EVENT_IOC_RESET, 0);
+	}
+	error.clear();
+	return true;
+}
+
+void PerfCounters::close() {
+	for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+		if (fds[e] >= 0) ::close(fds[e]);
+		fds[e] = -1;
+	}
+	openCount = 0;
+}
+
+void PerfCounters::read(PerfSample& out) const {
+	for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+		unsigned long long data[3];
+		if (fds[e] < 0 || ::read(fds[e], data, sizeof(data)) != (ssize_t)sizeof(data)) {
+			out.value[e] = -1;
+			continue;
+		}
+		// data: count, time enabled, time running
+		out.value[e] = (data[2] == 0) ? 0 : (data[2] < data[1])
+			? (long long)((double)data[0] * data[1] / data[2])
+			: (long long)data[0];
+	}
+}
+
+#else
+
+bool PerfCounters::open() {
+	error = "hardware counters need Linux perf_event_open";
+	return false;
+}
+
+void PerfCounters::close() {
+	openCount = 0;
+}
+
+void PerfCounters::read(PerfSample& out) const {
+	for (int e = 0; e < PERF_EVENT_COUNT; e++) out.value[e] = -1;
+}
+
+#endif
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+
+// Hardware event counts from perf_event_open (Linux only).
+enum PerfEvent {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_L1D_MISSES,
+	PERF_LLC_MISSES,
+	PERF_DTLB_MISSES,
+	PERF_BRANCH_MISSES,
+	PERF_EVENT_COUNT
+};
+
+// Counts per event; -1 where the event is not counted on this machine.
+struct PerfSample {
+	long long value[PERF_EVENT_COUNT];
+
+	// this - start, keeping -1 for events missing from either
+	PerfSample since(const PerfSample& start) const;
+	void add(const PerfSample& other);
+	static PerfSample zero();
+};
+
+// User-space counters of the calling thread. Events the CPU, kernel or
+// permissions do not allow are left out one by one, so an unprivileged or
+// virtualised machine gets whatever subset it offers, possibly none; on
+// other platforms open() always fails. Counts are scaled for multiplexing
+// when more events are requested than the PMU has registers.
+//
+// Threads other than the one that called open() are not counted, and the
+// solver's loops run on OpenMP workers: measure on one thread (as --bench
+// does) or the counts miss the workers' share of the cells.
+class PerfCounters {
+public:
+	PerfCounters();
+	~PerfCounters();
+
+	// False, with the reason in getError(), when no event could be opened.
+	bool open();
+	void close();
+	bool isOpen() const { return openCount > 0; }
+	bool has(PerfEvent e) const { return fds[e] >= 0; }
+	const std::string& getError() const { return error; }
+
+	// Counts since open(); all -1 when closed.
+	void read(PerfSample& out) const;
+
+	// short snake_case name, as used in the benchmark JSON
+	static const char* eventName(int e);
+
+private:
+	int fds[PERF_EVENT_COUNT];
+	int openCount;
+	std::string error;
+};
@@ -0,0 +1,227 @@
+#include "Profiler.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace {
+
+struct ThreadTimeline {
+	int tid;
+	std::string name;
+	std::mutex lock;
+	std::vector<ProfileEvent> events;
+	size_t next;
+	// stage totals, matched by name pointer
+	std::vector<ProfileTotal> totals;
+	PerfCounters counters;
+	bool countersTried;
+};
+
+struct StageAverage {
+	std::atomic<const char*> name;
+	std::atomic<float> averageMs;
+};
+
+std::atomic<bool> enabled(false);
+std::atomic<bool> countersEnabled(false);
+std::mutex registryLock;
+std::vector<std::unique_ptr<ThreadTimeline> > timelines;
+StageAverage stages[Profiler::MAX_STAGES];
+std::atomic<int> stageCount(0);
+
+const float AVERAGE_WEIGHT = 0.05f;
+
+ThreadTimeline& localTimeline() {
+	thread_local ThreadTimeline* timeline = nullptr;
+	if (timeline == nullptr) {
+		std::lock_guard<std::mutex> guard(registryLock);
+		timelines.push_back(std::unique_ptr<ThreadTimeline>(new ThreadTimeline()));
+		timeline = timelines.back().get();
+		timeline->tid = (int)timelines.size();
+		timeline->name = "thread " + std::to_string(timeline->tid);
+		timeline->next = 0;
+		timeline->countersTried = false;
+	}
+	return *timeline;
+}
+
+// Stage slots are found by pointer first; a name seen for the first time is
+// matched by content (literals from different files may differ) or registered.
+StageAverage* findStage(const char* name) {
+	int count = stageCount.load(std::memory_order_acquire);
+	for (int i = 0; i < count; i++) {
+		if (stages[i].name.load(std::memory_order_relaxed) == name) return &stages[i];
+	}
+	std::lock_guard<std::mutex> guard(registryLock);
+	count = stageCount.load(std::memory_order_relaxed);
+	for (int i = 0; i < count; i++) {
+		if (std::strcmp(stages[i].name.load(std::memory_order_relaxed), name) == 0) return &stages[i];
+	}
+	if (count == Profiler::MAX_STAGES) return nullptr;
+	stages[count].name.store(name, std::memory_order_relaxed);
+	stages[count].averageMs.store(-1.0f, std::memory_order_relaxed);
+	stageCount.store(count + 1, std::memory_order_release);
+	return &stages[count];
+}
+
+// JSON strings here are stage and thread names; only quotes and backslashes need escaping.
+std::string escape(const std::string& text) {
+	std::string out;
+	for (size_t i = 0; i < text.size(); i++) {
+		if (text[i] == '"' || text[i] == '\\') out += '\\';
+		out += text[i];
+	}
+	return out;
+}
+
+}
+
+void Profiler::setEnabled(bool on) {
+	enabled.store(on, std::memory_order_relaxed);
+}
+
+bool Profiler::isEnabled() {
+	return enabled.load(std::memory_order_relaxed);
+}
+
+void Profiler::setThreadName(const char* name) {
+	ThreadTimeline& timeline = localTimeline();
+	std::lock_guard<std::mutex> guard(timeline.lock);
+	timeline.name = name;
+}
+
+long long Profiler::now() {
+	static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+bool Profiler::setCountersEnabled(bool on) {
+	countersEnabled.store(on, std::memory_order_relaxed);
+	PerfSample probe;
+	return on && readCounters(probe);
+}
+
+bool Profiler::readCounters(PerfSample& out) {
+	if (!countersEnabled.load(std::memory_order_relaxed)) return false;
+	// Only the owning thread opens and reads its counters; no lock needed.
+	ThreadTimeline& timeline = localTimeline();
+	if (!timeline.countersTried) {
+		timeline.countersTried = true;
+		timeline.counters.open();
+	}
+	if (!timeline.counters.isOpen()) return false;
+	timeline.counters.read(out);
+	return true;
+}
+
+void Profiler::record(const char* name, long long startNs, long long endNs, const PerfSample* counters) {
+	ThreadTimeline& timeline = localTimeline();
+	ProfileEvent event = { name, startNs, endNs - startNs };
+	{
+		std::lock_guard<std::mutex> guard(timeline.lock);
+		if (timeline.events.size() < (size_t)MAX_EVENTS_PER_THREAD) {
+			timeline.events.push_back(event);
+		}
+		else {
+			timeline.events[timeline.next] = event;
+			timeline.next = (timeline.next + 1) % MAX_EVENTS_PER_THREAD;
+		}
+
+		size_t t = 0;
+		while (t < timeline.totals.size() && timeline.totals[t].name != name) t++;
+		if (t == timeline.totals.size()) {
+			ProfileTotal total = { name, 0, 0.0, PerfSample::zero() };
+			timeline.totals.push_back(total);
+		}
+		ProfileTotal& total = timeline.totals[t];
+		total.calls++;
+		total.totalMs += (endNs - startNs) * 1e-6;
+		if (counters != nullptr) {
+			total.counters.add(*counters);
+		}
+		else {
+			for (int e = 0; e < PERF_EVENT_COUNT; e++) total.counters.value[e] = -1;
+		}
+	}
+
+	StageAverage* stage = findStage(name);
+	if (stage == nullptr) return;
+	float ms = (endNs - startNs) * 1e-6f;
+	float previous = stage->averageMs.load(std::memory_order_relaxed);
+	stage->averageMs.store((previous < 0.0f) ? ms : previous + AVERAGE_WEIGHT * (ms - previous), std::memory_order_relaxed);
+}
+
+bool Profiler::writeChromeTrace(const char* path) {
+	std::ofstream out(path);
+	if (!out) return false;
+
+	std::lock_guard<std::mutex> guard(registryLock);
+	// microseconds, as the format expects, to the nanosecond
+	out << std::fixed << std::setprecision(3);
+	out << "{\"traceEvents\":[\n";
+	bool first = true;
+	for (size_t t = 0; t < timelines.size(); t++) {
+		ThreadTimeline& timeline = *timelines[t];
+		std::lock_guard<std::mutex> timelineGuard(timeline.lock);
+		out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << timeline.tid
+			<< ",\"args\":{\"name\":\"" << escape(timeline.name) << "\"}}";
+		first = false;
+		for (size_t e = 0; e < timeline.events.size(); e++) {
+			const ProfileEvent& ev = timeline.events[(timeline.next + e) % timeline.events.size()];
+			out << ",\n{\"name\":\"" << escape(ev.name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << timeline.tid
+				<< ",\"ts\":" << ev.startNs / 1000.0 << ",\"dur\":" << ev.durationNs / 1000.0 << "}";
+		}
+	}
+	out << "\n]}\n";
+	return (bool)out;
+}
+
+void Profiler::clear() {
+	std::lock_guard<std::mutex> guard(registryLock);
+	for (size_t t = 0; t < timelines.size(); t++) {
+		std::lock_guard<std::mutex> timelineGuard(timelines[t]->lock);
+		timelines[t]->events.clear();
+		timelines[t]->next = 0;
+		timelines[t]->totals.clear();
+	}
+	int count = stageCount.load(std::memory_order_relaxed);
+	for (int i = 0; i < count; i++) {
+		stages[i].averageMs.store(-1.0f, std::memory_order_relaxed);
+	}
+}
+
+void Profiler::getAverages(std::vector<ProfileAverage>& out) {
+	out.clear();
+	int count = stageCount.load(std::memory_order_acquire);
+	for (int i = 0; i < count; i++) {
+		float ms = stages[i].averageMs.load(std::memory_order_relaxed);
+		if (ms < 0.0f) continue;
+		ProfileAverage average = { stages[i].name.load(std::memory_order_relaxed), ms };
+		out.push_back(average);
+	}
+}
+
+void Profiler::getTotals(std::vector<ProfileTotal>& out) {
+	out.clear();
+	std::lock_guard<std::mutex> guard(registryLock);
+	for (size_t t = 0; t < timelines.size(); t++) {
+		std::lock_guard<std::mutex> timelineGuard(timelines[t]->lock);
+		const std::vector<ProfileTotal>& totals = timelines[t]->totals;
+		for (size_t i = 0; i < totals.size(); i++) {
+			size_t k = 0;
+			while (k < out.size() && std::strcmp(out[k].name, totals[i].name) != 0) k++;
+			if (k == out.size()) {
+				out.push_back(totals[i]);
+				continue;
+			}
+			out[k].calls += totals[i].calls;
+			out[k].totalMs += totals[i].totalMs;
+			out[k].counters.add(totals[i].counters);
+		}
+	}
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <vector>
+#include "PerfCounters.h"
+
+// Scoped wall-clock timers for the solver and renderer stages.
+//
+// PROFILE_SCOPE("name") times the enclosing block; PROFILE_STAGE("name") also
+// reads the hardware counters around it. Reading them is six read() calls at
+// each end, so only the solver stages take counters and small helpers called
+// many times per step (set_bnd) stay timing-only. The timers exist only when
+// FLUIDSIM_PROFILE is defined (the Debug and Profile configurations; Profile
+// is Release with the timers); otherwise the macro expands to nothing and costs
+// nothing. When compiled in, recording is switched on and off at run time with
+// Profiler::setEnabled, and a disabled scope costs one relaxed atomic load.
+//
+// Each thread records into its own timeline, which writeChromeTrace exports as
+// Chrome trace JSON (chrome://tracing, Perfetto). A rolling average per stage
+// name is kept alongside for the on-screen HUD, and totals per stage name
+// (calls, time and, for stages when switched on, hardware counters) for the
+// benchmark.
+// Totals are inclusive: a scope's counts contain those of scopes nested in it.
+
+struct ProfileEvent {
+	const char* name;
+	long long startNs;
+	long long durationNs;
+};
+
+struct ProfileAverage {
+	const char* name;
+	float averageMs;
+};
+
+struct ProfileTotal {
+	const char* name;
+	long long calls;
+	double totalMs;
+	// all -1 when counters were off or unavailable for the stage
+	PerfSample counters;
+};
+
+class Profiler {
+public:
+	static void setEnabled(bool enabled);
+	static bool isEnabled();
+
+	// Names the calling thread's timeline in the trace.
+	static void setThreadName(const char* name);
+
+	// Nanoseconds since the first call in this process.
+	static long long now();
+	// counters: the scope's counter deltas, or nullptr
+	static void record(const char* name, long long startNs, long long endNs, const PerfSample* counters = nullptr);
+
+	// Reads hardware counters around every PROFILE_STAGE while enabled. Each
+	// thread opens its counters on its first stage; returns whether the calling
+	// thread could (see PerfCounters for the fallback).
+	static bool setCountersEnabled(bool enabled);
+	// False when counters are off or unavailable on the calling thread.
+	static bool readCounters(PerfSample& out);
+
+	static bool writeChromeTrace(const char* path);
+	static void clear();
+	// Exponential rolling average of the duration of each stage, per call.
+	static void getAverages(std::vector<ProfileAverage>& out);
+	// Totals since the last clear(), summed over threads.
+	static void getTotals(std::vector<ProfileTotal>& out);
+
+	// per thread; older events are dropped beyond this
+	static const int MAX_EVENTS_PER_THREAD = 1 << 20;
+	static const int MAX_STAGES = 64;
+};
+
+class ProfileScope {
+public:
+	// counted: also read the hardware counters (PROFILE_STAGE)
+	explicit ProfileScope(const char* name, bool counted = false) : name(name), startNs(-1), counting(false) {
+		if (Profiler::isEnabled()) {
+			counting = counted && Profiler::readCounters(start);
+			startNs = Profiler::now();
+		}
+	}
+	~ProfileScope() {
+		if (startNs < 0) return;
+		long long endNs = Profiler::now();
+		PerfSample end;
+		if (counting && Profiler::readCounters(end)) {
+			PerfSample delta = end.since(start);
+			Profiler::record(name, startNs, endNs, &delta);
+		}
+		else {
+			Profiler::record(name, startNs, endNs);
+		}
+	}
+
+private:
+	const char* name;
+	long long startNs;
+	bool counting;
+	PerfSample start;
+};
+
+#ifdef FLUIDSIM_PROFILE
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(name)
+#define PROFILE_STAGE(name) ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(name, true)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_STAGE(name)
+#endif
@@ -0,0 +1,96 @@
+#include "QualityGovernor.h"
+#include <iostream>
+#include <algorithm>
+
+QualityGovernor::QualityGovernor(float budgetMs) {
+	this->budgetMs = budgetMs;
+	this->logging = true;
+	this->level = 0;
+	this->fitSteps = 0;
+	this->substeps = 1;
+	this->modelled = false;
+	this->densityDiffused = true;
+	this->diffuseSweepMs = this->projectSweepMs = this->fixedMs = 0.0f;
+
+	// Best first. Iterations go before stages: the projection before
+	// advection is the last thing the flow really misses, velocity diffusion
+	// matters only with viscosity.
+	const SolverQuality table[] = {
+		{ 20, 20, true, true },
+		{ 16, 16, true, true },
+		{ 12, 12, true, true },
+		{ 8, 10, false, true },
+		{ 6, 8, false, true },
+		{ 6, 8, false, false },
+		{ 4, 5, false, false },
+		{ 2, 3, false, false },
+	};
+	levels.assign(table, table + sizeof(table) / sizeof(table[0]));
+}
+
+// Sweeps each substep at `level` would run: two velocity diffusions when
+// enabled, one density diffusion unless the last step skipped it, one or two
+// projections. The next step is assumed to take as many substeps as the last.
+float QualityGovernor::predictMs(int level) const {
+	const SolverQuality& q = levels[level];
+	int diffuseSweeps = ((q.diffuseVelocity ? 2 : 0) + (densityDiffused ? 1 : 0)) * q.diffuseIterations;
+	int projectSweeps = (q.preProjection ? 2 : 1) * q.projectIterations;
+	return substeps * (fixedMs + diffuseSweeps * diffuseSweepMs + projectSweeps * projectSweepMs);
+}
+
+bool QualityGovernor::update(const StageTimes& times, float stepMs, int substeps) {
+	this->substeps = std::max(substeps, 1);
+	this->densityDiffused = times.densityDiffused;
+	float diffuseSample = (times.diffuseSweeps > 0) ? times.diffuseMs / times.diffuseSweeps : diffuseSweepMs;
+	float projectSample = (times.projectSweeps > 0) ? times.projectMs / times.projectSweeps : projectSweepMs;
+	float fixedSample = (times.advectMs + times.otherMs) / this->substeps;
+	if (!modelled) {
+		diffuseSweepMs = diffuseSample;
+		projectSweepMs = projectSample;
+		fixedMs = fixedSample;
+		modelled = true;
+	}
+	else {
+		diffuseSweepMs += SMOOTHING * (diffuseSample - diffuseSweepMs);
+		projectSweepMs += SMOOTHING * (projectSample - projectSweepMs);
+		fixedMs += SMOOTHING * (fixedSample - fixedMs);
+	}
+
+	// Best level the model says fits. When even the lowest does not, stay there.
+	int fits = (int)levels.size() - 1;
+	for (int l = 0; l < (int)levels.size(); l++) {
+		if (predictMs(l) <= HEADROOM * budgetMs) {
+			fits = l;
+			break;
+		}
+	}
+
+	int next = level;
+	if (fits > level || stepMs > budgetMs) {
+		// Over budget: drop at once, to the fitting level or at least one step.
+		next = std::max(fits, std::min(level + 1, (int)levels.size() - 1));
+		if (stepMs <= budgetMs) next = fits;
+		fitSteps = 0;
+	}
+	else if (fits < level) {
+		if (++fitSteps >= RAISE_AFTER) {
+			next = level - 1;
+			fitSteps = 0;
+		}
+	}
+	else {
+		fitSteps = 0;
+	}
+
+	if (next == level) return false;
+	if (logging) {
+		const SolverQuality& from = levels[level];
+		const SolverQuality& to = levels[next];
+		std::cout << "quality " << level << " -> " << next << ": diffuse " << from.diffuseIterations << " -> " << to.diffuseIterations
+			<< ", project " << from.projectIterations << " -> " << to.projectIterations
+			<< ", velocity diffusion " << (to.diffuseVelocity ? "on" : "off") << ", pre-projection " << (to.preProjection ? "on" : "off")
+			<< " (step " << stepMs << " ms, predicted " << predictMs(next) << " ms, budget " << budgetMs << " ms)" << std::endl;
+	}
+	level = next;
+	return true;
+}
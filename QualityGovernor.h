@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Fluidsim.h"
+#include <vector>
+
+// Picks solver effort (iteration counts and optional stages) per step to meet
+// a millisecond budget. A running model keeps the cost of one diffuse and one
+// project sweep and of everything else per substep; each step the best quality
+// level whose predicted time, times the substeps the last step took, fits the
+// budget is chosen. Quality drops as soon as a step
+// overruns and is raised only after the prediction has fitted for a while, so
+// a load spike degrades it at once and recovery does not oscillate. Every
+// change is logged with the step time that triggered it.
+class QualityGovernor {
+public:
+	QualityGovernor(float budgetMs);
+
+	float getBudgetMs() const { return budgetMs; }
+	void setLogging(bool enabled) { this->logging = enabled; }
+
+	// Feeds the stage times of the step just taken, summed over its
+	// `substeps` (Fluidsim::getLastSubsteps()). Returns true when the quality
+	// changed; apply it with Fluidsim::setQuality(getQuality()).
+	bool update(const StageTimes& times, float stepMs, int substeps);
+
+	const SolverQuality& getQuality() const { return levels[level]; }
+	int getLevel() const { return level; }
+	int getLevelCount() const { return (int)levels.size(); }
+	float predictMs(int level) const;
+
+private:
+	// steps a higher level must keep fitting before it is taken
+	static const int RAISE_AFTER = 20;
+	// aim below the budget to leave room for noise
+	static constexpr float HEADROOM = 0.9f;
+	static constexpr float SMOOTHING = 0.2f;
+
+	float budgetMs;
+	bool logging;
+	std::vector<SolverQuality> levels;
+	int level;
+	int fitSteps;
+	int substeps;
+
+	bool modelled;
+	// whether the density diffusion sweeps run (see StageTimes)
+	bool densityDiffused;
+	float diffuseSweepMs;
+	float projectSweepMs;
+	float fixedMs;
+};
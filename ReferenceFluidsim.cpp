@@ -0,0 +1,172 @@
+#include "ReferenceFluidsim.h"
+#include <algorithm>
+#include <cmath>
+
+ReferenceFluidsim::ReferenceFluidsim(int Nx, int Ny, float hx, float hy) {
+	this->Nx = Nx;
+	this->Ny = Ny;
+	this->hx = hx;
+	this->hy = hy;
+	size_t size = (size_t)(Nx + 2) * (Ny + 2);
+	density.assign(size, 0.0f);
+	s.assign(size, 0.0f);
+	vx.assign(size, 0.0f);
+	vy.assign(size, 0.0f);
+	vx0.assign(size, 0.0f);
+	vy0.assign(size, 0.0f);
+	fluid.assign(size, 1.0f);
+	solidVx.assign(size, 0.0f);
+	solidVy.assign(size, 0.0f);
+	fluidNbrX.assign(size, 0.0f);
+	fluidNbrY.assign(size, 0.0f);
+	invFluidNbr.assign(size, 0.0f);
+	updateCoefficients();
+}
+
+void ReferenceFluidsim::updateCoefficients() {
+	for (int j = 1; j <= Ny; j++) {
+		for (int i = 1; i <= Nx; i++) {
+			float nx = fluid[index(i - 1, j)] + fluid[index(i + 1, j)];
+			float ny = fluid[index(i, j - 1)] + fluid[index(i, j + 1)];
+			float n = nx * (hy / hx) + ny * (hx / hy);
+			fluidNbrX[index(i, j)] = nx;
+			fluidNbrY[index(i, j)] = ny;
+			invFluidNbr[index(i, j)] = (n > 0.0f) ? fluid[index(i, j)] / n : 0.0f;
+		}
+	}
+}
+
+void ReferenceFluidsim::set_bnd(int b, float* x) const {
+	for (int i = 1; i <= Nx; i++) {
+		x[index(i, Ny + 1)] = (b == 2) ? -x[index(i, Ny)] : x[index(i, Ny)];
+		x[index(i, 0)] = (b == 2) ? -x[index(i, 1)] : x[index(i, 1)];
+	}
+	for (int j = 1; j <= Ny; j++) {
+		x[index(Nx + 1, j)] = (b == 1) ? -x[index(Nx, j)] : x[index(Nx, j)];
+		x[index(0, j)] = (b == 1) ? -x[index(1, j)] : x[index(1, j)];
+	}
+	x[index(0, 0)] = 0.5f * (x[index(1, 0)] + x[index(0, 1)]);
+	x[index(Nx + 1, 0)] = 0.5f * (x[index(Nx, 0)] + x[index(Nx + 1, 1)]);
+	x[index(0, Ny + 1)] = 0.5f * (x[index(1, Ny + 1)] + x[index(0, Ny)]);
+	x[index(Nx + 1, Ny + 1)] = 0.5f * (x[index(Nx, Ny + 1)] + x[index(Nx + 1, Ny)]);
+}
+
+// Gauss-Seidel, rows bottom to top and cells left to right. Scalars (b = 0)
+// see zero-flux walls; velocities see no-slip walls moving with the solid.
+void ReferenceFluidsim::diffuse(int b, float* x, const float* x0, float diff, float dt, int iterations) const {
+	float ax = dt * diff / (hx * hx);
+	float ay = dt * diff / (hy * hy);
+	const std::vector<float>& wall = (b == 2) ? solidVy : solidVx;
+
+	for (int k = 0; k < iterations; k++) {
+		for (int j = 1; j <= Ny; j++) {
+			for (int i = 1; i <= Nx; i++) {
+				int c = index(i, j);
+				float n;
+				if (b == 0) n = ax * fluidNbrX[c] + ay * fluidNbrY[c];
+				else n = 2.0f * ax + 2.0f * ay;
+				if (fluid[c] > 0.5f) x[c] = (x0[c] + ax * (x[index(i - 1, j)] + x[index(i + 1, j)]) + ay * (x[index(i, j - 1)] + x[index(i, j + 1)])) / (1 + n);
+				else x[c] = (b == 0) ? 0.0f : wall[c];
+			}
+		}
+		set_bnd(b, x);
+	}
+}
+
+// Pressure scaled by the cell area; solid cells keep zero pressure and are
+// mirrored at their faces when the gradient is applied.
+void ReferenceFluidsim::project(float* velocX, float* velocY, float* p, float* div, int iterations) const {
+	float wx = hy / hx;
+	float wy = hx / hy;
+
+	for (int j = 1; j <= Ny; j++) {
+		for (int i = 1; i <= Nx; i++) {
+			int c = index(i, j);
+			float divergence = (velocX[index(i + 1, j)] - velocX[index(i - 1, j)]) * hy + (velocY[index(i, j + 1)] - velocY[index(i, j - 1)]) * hx;
+			div[c] = (fluid[c] > 0.5f) ? -0.5f * divergence : 0.0f;
+			p[c] = 0.0f;
+		}
+	}
+	set_bnd(0, div);
+	set_bnd(0, p);
+
+	for (int k = 0; k < iterations; k++) {
+		for (int j = 1; j <= Ny; j++) {
+			for (int i = 1; i <= Nx; i++) {
+				int c = index(i, j);
+				p[c] = (div[c] + wx * (p[index(i - 1, j)] + p[index(i + 1, j)]) + wy * (p[index(i, j - 1)] + p[index(i, j + 1)])) * invFluidNbr[c];
+			}
+		}
+		set_bnd(0, p);
+	}
+
+	for (int j = 1; j <= Ny; j++) {
+		for (int i = 1; i <= Nx; i++) {
+			int c = index(i, j);
+			if (fluid[c] < 0.5f) {
+				velocX[c] = solidVx[c];
+				velocY[c] = solidVy[c];
+				continue;
+			}
+			float pc = p[c];
+			float pl = (fluid[index(i - 1, j)] > 0.5f) ? p[index(i - 1, j)] : p[index(i - 1, j)] + pc;
+			float pr = (fluid[index(i + 1, j)] > 0.5f) ? p[index(i + 1, j)] : p[index(i + 1, j)] + pc;
+			float pd = (fluid[index(i, j - 1)] > 0.5f) ? p[index(i, j - 1)] : p[index(i, j - 1)] + pc;
+			float pu = (fluid[index(i, j + 1)] > 0.5f) ? p[index(i, j + 1)] : p[index(i, j + 1)] + pc;
+			velocX[c] = velocX[c] - 0.5f * (pr - pl) / hx;
+			velocY[c] = velocY[c] - 0.5f * (pu - pd) / hy;
+		}
+	}
+	set_bnd(1, velocX);
+	set_bnd(2, velocY);
+}
+
+// Semi-Lagrangian backtrace with bilinear sampling. Scalars are averaged over
+// the fluid corners only; velocities treat solid corners as wall velocity.
+void ReferenceFluidsim::advect(int b, float* d, const float* d0, const float* velocX, const float* velocY, float dt) const {
+	float dtx = dt / hx;
+	float dty = dt / hy;
+	const std::vector<float>& wall = (b == 2) ? solidVy : solidVx;
+
+	for (int j = 1; j <= Ny; j++) {
+		for (int i = 1; i <= Nx; i++) {
+			int c = index(i, j);
+			float x = std::min(std::max((float)i - dtx * velocX[c], 0.5f), (float)Nx + 0.5f);
+			float y = std::min(std::max((float)j - dty * velocY[c], 0.5f), (float)Ny + 0.5f);
+			int i0 = (int)std::floor(x);
+			int j0 = (int)std::floor(y);
+			float s1 = x - i0, s0 = 1.0f - s1;
+			float t1 = y - j0, t0 = 1.0f - t1;
+
+			int corners[4] = { index(i0, j0), index(i0, j0 + 1), index(i0 + 1, j0), index(i0 + 1, j0 + 1) };
+			float bilinear[4] = { s0 * t0, s0 * t1, s1 * t0, s1 * t1 };
+			float sum = 0.0f, weights = 0.0f;
+			for (int k = 0; k < 4; k++) {
+				float w = bilinear[k] * ((b == 0) ? fluid[corners[k]] : 1.0f);
+				sum += w * d0[corners[k]];
+				weights += w;
+			}
+
+			if (fluid[c] < 0.5f) d[c] = (b == 0) ? 0.0f : wall[c];
+			else d[c] = sum / std::max(weights, 1e-6f);
+		}
+	}
+	set_bnd(b, d);
+}
+
+// The same calls, with the same arguments, as Fluidsim::substep.
+void ReferenceFluidsim::step(float dt, float diff, float visc, int iterations) {
+	diffuse(1, vx0.data(), vx.data(), visc, dt, iterations);
+	diffuse(2, vy0.data(), vy.data(), visc, dt, iterations);
+	project(vx0.data(), vy0.data(), vx.data(), vy.data(), iterations);
+	advect(1, vx.data(), vx0.data(), vx0.data(), vy0.data(), dt);
+	advect(2, vy.data(), vy0.data(), vx0.data(), vy0.data(), dt);
+	project(vx.data(), vy.data(), vx0.data(), vy0.data(), iterations);
+	diffuse(0, s.data(), density.data(), diff, dt, iterations);
+	advect(0, density.data(), s.data(), vx.data(), vy.data(), dt);
+	for (int j = 1; j <= Ny; j++) {
+		for (int i = 1; i <= Nx; i++) {
+			density[index(i, j)] *= 0.995f;
+		}
+	}
+}
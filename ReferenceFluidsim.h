@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+
+// Frozen scalar reference for Fluidsim's kernels: set_bnd, diffuse, project
+// and advect written as plain loops over the whole domain, with no active
+// tiles, spans, threads or vector code. It is the definition that optimised
+// paths are checked against by --selftest, so keep it simple and do not
+// optimise it. It is frozen except for changes to the discretisation and for
+// bug fixes shared with Fluidsim, which must land in both at once.
+//
+// Fields and masks are public and laid out like Fluidsim's, (Nx+2) x (Ny+2)
+// with the ghost ring, so a harness can load identical inputs into both.
+class ReferenceFluidsim {
+public:
+	ReferenceFluidsim(int Nx, int Ny, float hx, float hy);
+
+	int Nx;
+	int Ny;
+	float hx;
+	float hy;
+
+	std::vector<float> density, s, vx, vy, vx0, vy0;
+	// 1 for fluid, 0 for solid, and the wall velocity of solid cells
+	std::vector<float> fluid, solidVx, solidVy;
+	// derived from `fluid` by updateCoefficients()
+	std::vector<float> fluidNbrX, fluidNbrY, invFluidNbr;
+
+	int index(int x, int y) const { return x + y * (Nx + 2); }
+	void updateCoefficients();
+
+	void set_bnd(int b, float* x) const;
+	void diffuse(int b, float* x, const float* x0, float diff, float dt, int iterations) const;
+	void project(float* velocX, float* velocY, float* p, float* div, int iterations) const;
+	void advect(int b, float* d, const float* d0, const float* velocX, const float* velocY, float dt) const;
+
+	// One Fluidsim::step() at full quality with density resolution 1 and no
+	// emitters or moving obstacles.
+	void step(float dt, float diff, float visc, int iterations);
+};
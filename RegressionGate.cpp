@@ -0,0 +1,202 @@
+#include "RegressionGate.h"
+#include "Benchmark.h"
+#include "BenchmarkReport.h"
+#include "Fluidsim.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static const int GATE_REPEATS = 9;
+static const int WARMUP_STEPS = 3;
+static const float DEFAULT_THRESHOLD = 5.0f;
+static const double CONFIDENCE = 0.95;
+// shortest timed part of one run, in ms
+static const double MIN_RUN_MS = 250.0;
+
+enum GateStage { GATE_STEP, GATE_DIFFUSE, GATE_PROJECT, GATE_ADVECT, GATE_OTHER, GATE_STAGES };
+static const char* gateStageNames[GATE_STAGES] = { "step", "diffuse", "project", "advect", "other" };
+
+struct MedianInterval {
+	double median;
+	double low;
+	double high;
+};
+
+// Median with the order-statistic interval [x(k), x(n-k+1)], k the largest
+// rank whose binomial(n, 1/2) tail stays within (1 - CONFIDENCE) / 2. Needs
+// no assumption about the shape of the timing distribution.
+static MedianInterval medianInterval(std::vector<double> samples) {
+	std::sort(samples.begin(), samples.end());
+	int n = (int)samples.size();
+	MedianInterval r;
+	r.median = (n % 2) ? samples[n / 2] : 0.5 * (samples[n / 2 - 1] + samples[n / 2]);
+
+	double alpha = (1.0 - CONFIDENCE) / 2.0;
+	double term = std::pow(0.5, n);
+	double tail = 0.0;
+	int k = 1;
+	// tail = P(X <= j - 1); rank j is allowed while it stays within alpha
+	for (int j = 1; j <= n / 2; j++) {
+		tail += term;
+		term = term * (n - (j - 1)) / j;
+		if (tail > alpha) break;
+		k = j;
+	}
+	r.low = samples[k - 1];
+	r.high = samples[n - k];
+	return r;
+}
+
+// Returns the timed length of the shortest run, in ms.
+static double measure(int N, int steps, MedianInterval out[GATE_STAGES]) {
+	std::vector<double> samples[GATE_STAGES];
+	double shortestMs = 0.0;
+	for (int r = 0; r < GATE_REPEATS; r++) {
+		Fluidsim sim(N);
+		addSwirl(sim);
+		for (int i = 0; i < WARMUP_STEPS; i++) {
+			sim.step();
+		}
+		double ms[GATE_STAGES] = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+		for (int i = 0; i < steps; i++) {
+			sim.step();
+			const StageTimes& t = sim.getLastStageTimes();
+			ms[GATE_STEP] += sim.getLastFrameMs();
+			ms[GATE_DIFFUSE] += t.diffuseMs;
+			ms[GATE_PROJECT] += t.projectMs;
+			ms[GATE_ADVECT] += t.advectMs;
+			ms[GATE_OTHER] += t.otherMs;
+		}
+		for (int s = 0; s < GATE_STAGES; s++) {
+			samples[s].push_back(ms[s] / steps);
+		}
+		shortestMs = (r == 0) ? ms[GATE_STEP] : std::min(shortestMs, ms[GATE_STEP]);
+	}
+	for (int s = 0; s < GATE_STAGES; s++) {
+		out[s] = medianInterval(samples[s]);
+	}
+	return shortestMs;
+}
+
+// Steps, at least `steps`, for one run to last MIN_RUN_MS, from a trial run
+// with 20 % to spare.
+static int stepsForMinimumRun(int N, int steps) {
+	Fluidsim sim(N);
+	addSwirl(sim);
+	for (int i = 0; i < WARMUP_STEPS; i++) {
+		sim.step();
+	}
+	double ms = 0.0;
+	for (int i = 0; i < steps; i++) {
+		sim.step();
+		ms += sim.getLastFrameMs();
+	}
+	if (ms >= 1.2 * MIN_RUN_MS) return steps;
+	return (int)std::ceil(steps * 1.2 * MIN_RUN_MS / std::max(ms, 1e-3));
+}
+
+static std::string metricName(int stage, const char* field) {
+	return std::string("gate.") + gateStageNames[stage] + "." + field;
+}
+
+static std::string formatInterval(const MedianInterval& m) {
+	std::ostringstream text;
+	text << std::fixed << std::setprecision(3) << m.median << " [" << m.low << ", " << m.high << "]";
+	return text.str();
+}
+
+int runRegressionGate(int argc, char** argv) {
+	BenchmarkOptions options(256, 10);
+	if (!parseBenchmarkOptions(argc, argv, options)) return 2;
+	float threshold = (options.threshold >= 0.0f) ? options.threshold : DEFAULT_THRESHOLD;
+
+	BenchmarkReport baseline;
+	MedianInterval base[GATE_STAGES];
+	if (options.baselinePath != nullptr) {
+		double n, steps, runMs;
+		bool ok = baseline.read(options.baselinePath) && baseline.getInfo("n", n) && baseline.getInfo("steps", steps);
+		for (int s = 0; ok && s < GATE_STAGES; s++) {
+			ok = baseline.getMetric(metricName(s, "median_ms"), base[s].median)
+				&& baseline.getMetric(metricName(s, "ci_low_ms"), base[s].low)
+				&& baseline.getMetric(metricName(s, "ci_high_ms"), base[s].high);
+		}
+		if (!ok) {
+			std::cerr << "could not read a gate baseline from " << options.baselinePath << std::endl;
+			return 2;
+		}
+		if (!baseline.getInfo("min_run_ms", runMs) || runMs < MIN_RUN_MS) {
+			std::cerr << options.baselinePath << " was recorded with runs shorter than " << MIN_RUN_MS << " ms; record it again" << std::endl;
+			return 2;
+		}
+		// the comparison is only meaningful on the baseline's workload
+		options.N = (int)n;
+		options.steps = (int)steps;
+	}
+
+	else {
+		int steps = stepsForMinimumRun(options.N, options.steps);
+		if (steps > options.steps) {
+			std::cout << options.steps << " steps run shorter than " << MIN_RUN_MS << " ms; using " << steps << std::endl;
+			options.steps = steps;
+		}
+	}
+
+	MedianInterval current[GATE_STAGES];
+	double runMs = measure(options.N, options.steps, current);
+
+	BenchmarkReport report;
+	report.setInfo("n", options.N);
+	report.setInfo("steps", options.steps);
+	report.setInfo("repeats", GATE_REPEATS);
+	report.setInfo("min_run_ms", runMs);
+	for (int s = 0; s < GATE_STAGES; s++) {
+		report.setMetric(metricName(s, "median_ms"), current[s].median);
+		report.setMetric(metricName(s, "ci_low_ms"), current[s].low);
+		report.setMetric(metricName(s, "ci_high_ms"), current[s].high);
+	}
+
+	std::cout << "N = " << options.N << ", " << GATE_REPEATS << " runs of " << options.steps << " steps, median ms/step ["
+		<< (int)(CONFIDENCE * 100) << " % interval]" << std::endl;
+	int regressions = 0;
+	if (options.baselinePath == nullptr) {
+		for (int s = 0; s < GATE_STAGES; s++) {
+			std::cout << "  " << std::left << std::setw(9) << gateStageNames[s] << std::right << formatInterval(current[s]) << std::endl;
+		}
+	}
+	else {
+		std::cout << "  " << std::left << std::setw(9) << "stage" << std::setw(28) << "baseline" << std::setw(28) << "current"
+			<< std::right << std::setw(9) << "change" << "  verdict" << std::endl;
+		for (int s = 0; s < GATE_STAGES; s++) {
+			double change = (current[s].median / base[s].median - 1.0) * 100.0;
+			bool slower = current[s].low > base[s].high;
+			bool faster = current[s].high < base[s].low;
+			const char* verdict = "same";
+			if (slower && change > threshold) {
+				verdict = "REGRESSION";
+				regressions++;
+			}
+			else if (slower) verdict = "slower";
+			else if (faster) verdict = "faster";
+
+			std::cout << "  " << std::left << std::setw(9) << gateStageNames[s] << std::setw(28) << formatInterval(base[s])
+				<< std::setw(28) << formatInterval(current[s]) << std::right << std::fixed << std::setprecision(1)
+				<< std::setw(8) << change << "%  " << verdict << std::defaultfloat << std::setprecision(6) << std::endl;
+			report.setMetric(metricName(s, "change_percent"), change);
+		}
+		std::cout << (regressions ? "FAIL: " : "PASS: ") << regressions << " stage(s) more than " << threshold
+			<< " % slower with non-overlapping intervals" << std::endl;
+	}
+
+	if (options.jsonPath != nullptr) {
+		if (!report.write(options.jsonPath)) {
+			std::cerr << "could not write " << options.jsonPath << std::endl;
+			return 2;
+		}
+		std::cout << "results written to " << options.jsonPath << std::endl;
+	}
+	return regressions ? 1 : 0;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+// `--gate [N] [steps] [--baseline <path>] [--threshold <percent>] [--json <path>]`
+//
+// Times step() and its stages (diffuse, project, advect, other) on a fully
+// active N x N swirl in GATE_REPEATS independent runs, and summarises each
+// stage by its median with a distribution-free 95 % confidence interval.
+// When `steps` would make a run shorter than MIN_RUN_MS, it is raised so
+// timer resolution and one-off stalls do not dominate a run.
+//
+// With --json the summary is written as a baseline; commit it next to the
+// change it describes. With --baseline the run is compared against it, at
+// the baseline's N and steps, and a per-stage table is printed; baselines
+// whose runs were shorter than MIN_RUN_MS are rejected. A stage regresses
+// when its median is more than `threshold` percent (default 5) slower and
+// the two confidence intervals do not overlap. The intervals only cover the
+// noise between runs of one invocation: drift between invocations (clock
+// boost, thermal state, other load) can still fail the gate, so re-run a
+// failure before trusting it.
+//
+// Exit status: 0 when nothing regressed, 1 when something did, 2 on bad
+// arguments or an unreadable baseline.
+int runRegressionGate(int argc, char** argv);
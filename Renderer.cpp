@@ -1,6 +1,9 @@
 ﻿#include "Renderer.h"
+#include "Profiler.h"
 #include <iostream>
 #include <vector>
+#include <cstdio>
+#include <cstring>
 
 //vertex shader
 const char* vertexShaderSource = R"(
@@ -32,16 +35,45 @@ void main() {
         color.g = density * 0.6;        // Cyan/electric blue
         color.b = density * 1.0;        // Full blue
     }
+    if (texture(fluidTexture, TexCoords).g > 0.5) {
+        color = vec3(0.45, 0.45, 0.5);  // Solid obstacle
+    }
+    if (texture(fluidTexture, TexCoords).b > 0.5) {
+        color = mix(color, vec3(1.0, 0.8, 0.0), 0.5);  // Active tile outline
+    }
     
     FragColor = vec4(color, 1.0);
 }
 )";
 
-Renderer::Renderer(int screenWidth, int screenHeight, int gridSize) {
-    this->gridSize = gridSize;
+const char* hudFragmentShaderSource = R"(
+    #version 330 core
+    out vec4 FragColor;
+    in vec2 TexCoords;
+    uniform sampler2D hudTexture;
+void main() {
+    FragColor = texture(hudTexture, TexCoords);
+}
+)";
+
+// 3x5 HUD font: one octal digit per row, top row first, high bit on the left.
+static const char hudGlyphs[] = "0123456789abcdefghijklmnopqrstuvwxyz._/-";
+static const unsigned short hudFont[] = {
+    075557, 026227, 071747, 071717, 055711, 074717, 074757, 071111, 075757, 075717,
+    025755, 065656, 034443, 065556, 074647, 074644, 034553, 055755, 072227, 011152,
+    055655, 044447, 057755, 065555, 025552, 065644, 025563, 065655, 034216, 072222,
+    055557, 055552, 055775, 055255, 055222, 071247, 000002, 000007, 011244, 000700
+};
+
+Renderer::Renderer(int screenWidth, int screenHeight, int gridWidth, int gridHeight, int densityScale) {
+    this->gridWidth = gridWidth;
+    this->gridHeight = gridHeight;
+    this->densityScale = densityScale;
+    this->overlayTiles = nullptr;
+    this->overlayTilesX = this->overlayTilesY = this->overlayTileSize = 0;
 
     this->shaderProgram = createShader(vertexShaderSource, fragmentShaderSource);
-    this->textureData = new unsigned char[gridSize * gridSize * 4];
+    this->textureData = new unsigned char[gridWidth * densityScale * gridHeight * densityScale * 4];
 
     glGenTextures(1, &this->textureID);
     glBindTexture(GL_TEXTURE_2D, this->textureID);
@@ -51,7 +83,7 @@ Renderer::Renderer(int screenWidth, int screenHeight, int gridSize) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, gridSize, gridSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, gridWidth * densityScale, gridHeight * densityScale, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 
     float vertices[] = {
         -1.0f, -1.0f, 0.0f, 0.0f,
@@ -88,6 +120,45 @@ Renderer::Renderer(int screenWidth, int screenHeight, int gridSize) {
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 
+    // HUD: a texture drawn 2.5x magnified with nearest filtering.
+    this->hudShader = createShader(vertexShaderSource, hudFragmentShaderSource);
+    this->hudData = new unsigned char[HUD_WIDTH * HUD_HEIGHT * 4];
+
+    glGenTextures(1, &this->hudTexture);
+    glBindTexture(GL_TEXTURE_2D, this->hudTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, HUD_WIDTH, HUD_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    float hudW = 2.5f * HUD_WIDTH * 2.0f / screenWidth;
+    float hudH = 2.5f * HUD_HEIGHT * 2.0f / screenHeight;
+    float hudVertices[] = {
+        -1.0f, 1.0f - hudH, 0.0f, 0.0f,
+        -1.0f + hudW, 1.0f - hudH, 1.0f, 0.0f,
+        -1.0f + hudW, 1.0f, 1.0f, 1.0f,
+        -1.0f, 1.0f, 0.0f, 1.0f
+    };
+
+    unsigned int hudVbo, hudEbo;
+    glGenVertexArrays(1, &this->hudVao);
+    glGenBuffers(1, &hudVbo);
+    glGenBuffers(1, &hudEbo);
+
+    glBindVertexArray(this->hudVao);
+    glBindBuffer(GL_ARRAY_BUFFER, hudVbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(hudVertices), hudVertices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, hudEbo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
 }
 
 Renderer::~Renderer() {
@@ -95,42 +166,157 @@ Renderer::~Renderer() {
     glDeleteTextures(1, &textureID);
     glDeleteVertexArrays(1, &vaoID);
     delete[] textureData;
+    glDeleteProgram(hudShader);
+    glDeleteTextures(1, &hudTexture);
+    glDeleteVertexArrays(1, &hudVao);
+    delete[] hudData;
 }
-void Renderer::draw(float* densityData) {
-    int N = this->gridSize;
+void Renderer::draw(const float* densityData, const float* fluidMask) {
+    // The texture has one texel per density cell; the mask and tiles are on the
+    // coarse grid, densityScale texels per cell.
+    int Nx = this->gridWidth * densityScale;
+    int Ny = this->gridHeight * densityScale;
 
-    float maxDensity = 0.0f;
-    for (int i = 0; i < (N + 2) * (N + 2); i++) {
-        if (densityData[i] > maxDensity) {
-            maxDensity = densityData[i];
+    {
+        PROFILE_SCOPE("draw/convert");
+        float maxDensity = 0.0f;
+        for (int i = 0; i < (Nx + 2) * (Ny + 2); i++) {
+            if (densityData[i] > maxDensity) {
+                maxDensity = densityData[i];
+            }
         }
-    }
-    std::cout << "Max density: " << maxDensity << std::endl;
+        std::cout << "Max density: " << maxDensity << std::endl;
 
-    for (int y = 0; y < N; y++) {
-        for (int x = 0; x < N; x++) {
-            int idx = (x + y * N);
-            int fluidIdx = (x + 1) + (y + 1) * (N + 2);
+        for (int y = 0; y < Ny; y++) {
+            for (int x = 0; x < Nx; x++) {
+                int idx = (x + y * Nx);
+                int fluidIdx = (x + 1) + (y + 1) * (Nx + 2);
+                int maskIdx = (x / densityScale + 1) + (y / densityScale + 1) * (gridWidth + 2);
 
-            float d = densityData[fluidIdx];
-            if (d > 1.0f) d = 1.0f;
-            if (d < 0.0f) d = 0.0f;
-            unsigned char densityByte = (unsigned char)(d * 255.0f);
+                float d = densityData[fluidIdx];
+                if (d > 1.0f) d = 1.0f;
+                if (d < 0.0f) d = 0.0f;
+                unsigned char densityByte = (unsigned char)(d * 255.0f);
 
-            textureData[idx * 4 + 0] = densityByte;
-            textureData[idx * 4 + 1] = 0;
-            textureData[idx * 4 + 2] = 0;
-            textureData[idx * 4 + 3] = 255;
+                textureData[idx * 4 + 0] = densityByte;
+                textureData[idx * 4 + 1] = (fluidMask != nullptr && fluidMask[maskIdx] < 0.5f) ? 255 : 0;
+                textureData[idx * 4 + 2] = 0;
+                textureData[idx * 4 + 3] = 255;
 
+                if (overlayTiles != nullptr) {
+                    int tilePixels = overlayTileSize * densityScale;
+                    int tx = x / tilePixels;
+                    int ty = y / tilePixels;
+                    bool edge = (x % tilePixels == 0) || (y % tilePixels == 0);
+                    if (edge && tx < overlayTilesX && ty < overlayTilesY && overlayTiles[tx + ty * overlayTilesX]) {
+                        textureData[idx * 4 + 2] = 255;
+                    }
+                }
+
+            }
         }
     }
 
+    {
+        PROFILE_SCOPE("draw/upload");
+        glBindTexture(GL_TEXTURE_2D, this->textureID);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, Nx, Ny, GL_RGBA, GL_UNSIGNED_BYTE, textureData);
+    }
+
+    {
+        // CPU-side submission only; the GPU runs it asynchronously.
+        PROFILE_SCOPE("draw/call");
+        glUseProgram(this->shaderProgram);
+        glBindVertexArray(this->vaoID);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    }
+}
+
+void Renderer::resize(int gridWidth, int gridHeight) {
+    if (gridWidth == this->gridWidth && gridHeight == this->gridHeight) return;
+    this->gridWidth = gridWidth;
+    this->gridHeight = gridHeight;
+
+    delete[] textureData;
+    this->textureData = new unsigned char[gridWidth * densityScale * gridHeight * densityScale * 4];
     glBindTexture(GL_TEXTURE_2D, this->textureID);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, N, N, GL_RGBA, GL_UNSIGNED_BYTE, textureData);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, gridWidth * densityScale, gridHeight * densityScale, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+}
 
-    glUseProgram(this->shaderProgram);
-    glBindVertexArray(this->vaoID);
+void Renderer::setTileOverlay(const unsigned char* activeTiles, int tilesX, int tilesY, int tileSize) {
+    this->overlayTiles = activeTiles;
+    this->overlayTilesX = tilesX;
+    this->overlayTilesY = tilesY;
+    this->overlayTileSize = tileSize;
+}
+
+// x, y: top-left pixel of the text, y counted from the top of the HUD.
+void Renderer::hudText(int x, int y, const char* text) {
+    for (; *text != '\0' && x + 3 <= HUD_WIDTH; text++, x += 4) {
+        const char* g = std::strchr(hudGlyphs, *text);
+        if (g == nullptr) continue;
+        unsigned short bits = hudFont[g - hudGlyphs];
+        for (int row = 0; row < 5; row++) {
+            int rowBits = (bits >> (3 * (4 - row))) & 7;
+            for (int col = 0; col < 3; col++) {
+                if (!(rowBits & (4 >> col))) continue;
+                // the texture's first row is the bottom of the quad
+                unsigned char* p = hudData + ((HUD_HEIGHT - 1 - (y + row)) * HUD_WIDTH + x + col) * 4;
+                p[0] = p[1] = p[2] = p[3] = 255;
+            }
+        }
+    }
+}
+
+void Renderer::drawHud(const std::vector<ProfileAverage>& stages) {
+    int rows = (int)stages.size();
+    if (rows > HUD_HEIGHT / HUD_ROW) rows = HUD_HEIGHT / HUD_ROW;
+
+    float maxMs = 0.0f;
+    for (int i = 0; i < rows; i++) {
+        if (stages[i].averageMs > maxMs) maxMs = stages[i].averageMs;
+    }
+
+    // Label in 0..47, bar in 50..97, value from 100.
+    const int barX = 50;
+    const int barWidth = 48;
+    std::memset(hudData, 0, HUD_WIDTH * HUD_HEIGHT * 4);
+    for (int y = 0; y < rows * HUD_ROW; y++) {
+        for (int x = 0; x < HUD_WIDTH; x++) {
+            hudData[((HUD_HEIGHT - 1 - y) * HUD_WIDTH + x) * 4 + 3] = 160;
+        }
+    }
+    for (int i = 0; i < rows; i++) {
+        int y = i * HUD_ROW + 1;
+        char label[13];
+        std::snprintf(label, sizeof(label), "%s", stages[i].name);
+        hudText(1, y, label);
+
+        int bar = maxMs > 0.0f ? (int)(stages[i].averageMs / maxMs * barWidth + 0.5f) : 0;
+        for (int row = y; row < y + 5; row++) {
+            for (int x = barX; x < barX + bar; x++) {
+                unsigned char* p = hudData + ((HUD_HEIGHT - 1 - row) * HUD_WIDTH + x) * 4;
+                p[0] = 255;
+                p[1] = 170;
+                p[2] = 0;
+                p[3] = 255;
+            }
+        }
+
+        char value[16];
+        std::snprintf(value, sizeof(value), "%.2f", stages[i].averageMs);
+        hudText(barX + barWidth + 2, y, value);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, this->hudTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, HUD_WIDTH, HUD_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, hudData);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glUseProgram(this->hudShader);
+    glBindVertexArray(this->hudVao);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    glDisable(GL_BLEND);
 }
 
 unsigned int Renderer::createShader(const char* vertexSource, const char* fragmentSource) {
@@ -1,22 +1,53 @@
 #pragma once
 
 #include <GL/glew.h> 
+#include <vector>
 // ---------------
 
+struct ProfileAverage;
+
 class Renderer {
 public:
-    Renderer(int screenWidth, int screenHeight, int gridSize);
+    // densityScale: density cells per grid cell along each axis (see
+    // Fluidsim::setDensityResolution); draw() then takes the fine density array.
+    Renderer(int screenWidth, int screenHeight, int gridWidth, int gridHeight, int densityScale = 1);
     ~Renderer(); 
 
-    void draw(float* densityData);
+    void draw(const float* densityData, const float* fluidMask = nullptr);
+    // Re-creates the texture for a new grid size (same density scale).
+    void resize(int gridWidth, int gridHeight);
+    int getGridWidth() const { return gridWidth; }
+    int getGridHeight() const { return gridHeight; }
+    // Debug overlay: outlines the simulated tiles on the next draw calls. Pass
+    // nullptr to turn it off.
+    void setTileOverlay(const unsigned char* activeTiles, int tilesX, int tilesY, int tileSize);
+    // Profiler HUD in the top-left corner: one row per stage with its rolling
+    // average as a bar and in ms. Drawn over whatever draw() left.
+    void drawHud(const std::vector<ProfileAverage>& stages);
 
 private:
     unsigned int createShader(const char* vertexSource, const char* fragmentSource);
+    void hudText(int x, int y, const char* text);
 
     unsigned int shaderProgram;
     unsigned int textureID;
     unsigned int vaoID;
 
-    int gridSize;
+    int gridWidth;
+    int gridHeight;
+    int densityScale;
     unsigned char* textureData;
+
+    const unsigned char* overlayTiles;
+    int overlayTilesX;
+    int overlayTilesY;
+    int overlayTileSize;
+
+    static const int HUD_WIDTH = 128;
+    static const int HUD_HEIGHT = 112;
+    static const int HUD_ROW = 7;
+    unsigned int hudShader;
+    unsigned int hudTexture;
+    unsigned int hudVao;
+    unsigned char* hudData;
 };
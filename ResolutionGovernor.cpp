@@ -0,0 +1,48 @@
+#include "ResolutionGovernor.h"
+#include "Fluidsim.h"
+#include <cmath>
+#include <algorithm>
+
+ResolutionGovernor::ResolutionGovernor(int baseWidth, int baseHeight, float budgetMs) {
+	this->baseWidth = baseWidth;
+	this->baseHeight = baseHeight;
+	this->budgetMs = budgetMs;
+	this->minWidth = Fluidsim::TILE_SIZE * 2;
+	this->maxWidth = std::max(baseWidth * 4 / Fluidsim::TILE_SIZE * Fluidsim::TILE_SIZE, this->minWidth);
+
+	this->width = baseWidth;
+	this->height = baseHeight;
+	this->averageMs = 0.0f;
+	this->samples = 0;
+}
+
+void ResolutionGovernor::setLimits(int minWidth, int maxWidth) {
+	// whole tiles, the minimum rounded up and the maximum down; by value, as
+	// std::max binds references, which would need a definition
+	const int tile = Fluidsim::TILE_SIZE;
+	this->minWidth = std::max((minWidth + tile - 1) / tile * tile, tile);
+	this->maxWidth = std::max(maxWidth / tile * tile, this->minWidth);
+}
+
+bool ResolutionGovernor::update(float stepMs) {
+	averageMs = (samples == 0) ? stepMs : 0.9f * averageMs + 0.1f * stepMs;
+	samples++;
+	if (samples < SETTLE_STEPS) return false;
+	if (averageMs <= HIGH_WATER * budgetMs && averageMs >= LOW_WATER * budgetMs) return false;
+
+	float scale = std::sqrt(TARGET * budgetMs / std::max(averageMs, 1e-3f));
+	scale = std::min(scale, (float)MAX_GROWTH);
+	// to the nearest whole tile, and at least one tile in the wanted direction
+	const int tile = Fluidsim::TILE_SIZE;
+	int target = (int)(width * scale / tile + 0.5f) * tile;
+	if (target == width) target += (scale > 1.0f) ? tile : -tile;
+	target = std::min(std::max(target, minWidth), maxWidth);
+	if (target == width) return false;
+
+	// the height to the nearest whole tile of the base aspect ratio
+	long long rows = ((long long)target * baseHeight + (long long)baseWidth * tile / 2) / ((long long)baseWidth * tile);
+	width = target;
+	height = std::max((int)rows, 1) * tile;
+	samples = 0;
+	return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+// Chooses the grid size that keeps the measured step time inside a budget.
+// Step cost is taken to scale with the cell count, so a width change of
+// sqrt(budget / time) brings the step back on target; the aspect ratio of the
+// base grid is kept as closely as whole tiles allow. Decisions wait for the
+// smoothed time to settle after every change. Both sizes it picks, and the
+// width limits, are multiples of Fluidsim::TILE_SIZE; the base grid is used
+// as given until the first resize.
+class ResolutionGovernor {
+public:
+	ResolutionGovernor(int baseWidth, int baseHeight, float budgetMs);
+
+	void setLimits(int minWidth, int maxWidth);
+	float getBudgetMs() const { return budgetMs; }
+
+	// Feeds one measured step. Returns true when the grid should be resized to
+	// getWidth() x getHeight().
+	bool update(float stepMs);
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	float getAverageMs() const { return averageMs; }
+
+private:
+	// steps to let the average settle after a change
+	static const int SETTLE_STEPS = 30;
+	// shrink above this fraction of the budget, grow below the lower one
+	static constexpr float HIGH_WATER = 1.0f;
+	static constexpr float LOW_WATER = 0.6f;
+	// resize to land at this fraction of the budget
+	static constexpr float TARGET = 0.85f;
+	static constexpr float MAX_GROWTH = 1.25f;
+
+	int baseWidth;
+	int baseHeight;
+	float budgetMs;
+	int minWidth;
+	int maxWidth;
+
+	int width;
+	int height;
+	float averageMs;
+	int samples;
+};
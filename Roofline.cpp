@@ -0,0 +1,181 @@
+#include "Roofline.h"
+#include "Benchmark.h"
+#include "BenchmarkReport.h"
+#include "Fluidsim.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+// Bytes and flops per cell for one pass of each Fluidsim kernel, counted from
+// the code. Traffic is compulsory traffic: every array a pass touches is read
+// (and written, if it is an output) once per cell; stencil neighbours and the
+// advection gathers are assumed to hit cache. Floats are 4 bytes. Compares,
+// clamps and floor() count as one flop each where they are arithmetic.
+struct PassModel {
+	double bytes;
+	double flops;
+};
+
+// diffuse sweep: reads x0, fluid, fluidNbrX, fluidNbrY, wall, x; writes x.
+// 9 flops for the neighbour weight, 7 for the stencil, 3 to scale and
+// divide, 4 for the wall term.
+static const PassModel DIFFUSE_SWEEP = { 7 * 4, 23 };
+// project sweep: reads div, invFluidNbr, p; writes p. 4 adds, 3 multiplies.
+static const PassModel PROJECT_SWEEP = { 4 * 4, 7 };
+// project, once per call: the divergence pass (reads velocX, velocY, fluid;
+// writes div and p; 7 flops) and the gradient pass (reads p, fluid, solidVx,
+// solidVy, velocX, velocY; writes velocX, velocY; 12 flops for the mirrored
+// pressures, 8 per velocity component).
+static const PassModel PROJECT_ONCE = { (5 + 8) * 4, 7 + 28 };
+// advect: reads velocX, velocY, fluid, d0, wall; writes d. 8 for the
+// backtrace and floor, 4 for the fractions, 20 for the four fluid weights,
+// 4 for their sum, 9 to interpolate and normalise, 4 for the wall term.
+static const PassModel ADVECT = { 6 * 4, 49 };
+
+// volatile so the calibration loops are not folded away
+static volatile float sink;
+
+static double triadGBs(int n, int repeats) {
+	std::vector<float> a(n, 0.0f), b(n, 1.0f), c(n, 2.0f);
+	double best = 0.0;
+	for (int r = 0; r < repeats; r++) {
+		auto t0 = std::chrono::high_resolution_clock::now();
+		const float scalar = 3.0f;
+		for (int i = 0; i < n; i++) {
+			a[i] = b[i] + scalar * c[i];
+		}
+		auto t1 = std::chrono::high_resolution_clock::now();
+		sink = a[r % n];
+		double seconds = std::chrono::duration<double>(t1 - t0).count();
+		// STREAM convention: two reads and one write, no write-allocate traffic
+		if (seconds > 0.0) best = std::max(best, 3.0 * sizeof(float) * n / seconds * 1e-9);
+	}
+	return best;
+}
+
+static double peakGflops(int repeats) {
+	const int CHAINS = 32;
+	const int ROUNDS = 1 << 20;
+	float acc[CHAINS];
+	double best = 0.0;
+	for (int r = 0; r < repeats; r++) {
+		for (int k = 0; k < CHAINS; k++) acc[k] = 1.0f + k * 1e-3f;
+		float m = sink * 0.0f + 0.999999f;
+		float add = sink * 0.0f + 1e-7f;
+		auto t0 = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < ROUNDS; i++) {
+			for (int k = 0; k < CHAINS; k++) acc[k] = acc[k] * m + add;
+		}
+		auto t1 = std::chrono::high_resolution_clock::now();
+		float total = 0.0f;
+		for (int k = 0; k < CHAINS; k++) total += acc[k];
+		sink = total;
+		double seconds = std::chrono::duration<double>(t1 - t0).count();
+		if (seconds > 0.0) best = std::max(best, 2.0 * CHAINS * ROUNDS / seconds * 1e-9);
+	}
+	return best;
+}
+
+MachinePeaks calibratePeaks(int fieldFloats) {
+	MachinePeaks peaks;
+	peaks.memoryGBs = triadGBs(1 << 24, 5);
+	// enough repeats of the small triad to outlast timer resolution
+	peaks.fieldGBs = triadGBs(fieldFloats, std::max(5, (1 << 24) / std::max(fieldFloats, 1)));
+	peaks.gflops = peakGflops(5);
+	return peaks;
+}
+
+int runRoofline(int argc, char** argv) {
+	BenchmarkOptions options(256, 50);
+	if (!parseBenchmarkOptions(argc, argv, options)) return 1;
+	int N = (options.N + Fluidsim::TILE_SIZE - 1) / Fluidsim::TILE_SIZE * Fluidsim::TILE_SIZE;
+	int steps = options.steps;
+	// the peaks are per core, so the stages must be too
+	ScopedThreadCount oneThread(1);
+
+	MachinePeaks peaks = calibratePeaks((N + 2) * (N + 2));
+	std::cout << "peaks (one thread): memory " << peaks.memoryGBs << " GB/s, " << N << "^2 field " << peaks.fieldGBs
+		<< " GB/s, " << peaks.gflops << " GFLOP/s" << std::endl;
+
+	Fluidsim sim(N);
+	addSwirl(sim);
+	sim.step();
+
+	double diffuseMs = 0.0, projectMs = 0.0, advectMs = 0.0;
+	double diffuseCells = 0.0, projectSweepCells = 0.0, projectCallCells = 0.0, advectCells = 0.0;
+	for (int i = 0; i < steps; i++) {
+		sim.step();
+		const StageTimes& t = sim.getLastStageTimes();
+		double cells = (double)std::min(sim.getActiveTileCount() * Fluidsim::TILE_SIZE * Fluidsim::TILE_SIZE, N * N);
+		int projectCalls = t.projectSweeps / std::max(sim.getQuality().projectIterations, 1);
+		diffuseMs += t.diffuseMs;
+		projectMs += t.projectMs;
+		advectMs += t.advectMs;
+		diffuseCells += cells * t.diffuseSweeps;
+		projectSweepCells += cells * t.projectSweeps;
+		projectCallCells += cells * projectCalls;
+		// velocity x, velocity y and density
+		advectCells += cells * 3;
+	}
+
+	struct Stage {
+		const char* name;
+		double ms;
+		double bytes;
+		double flops;
+	};
+	Stage stages[3] = {
+		{ "diffuse", diffuseMs, diffuseCells * DIFFUSE_SWEEP.bytes, diffuseCells * DIFFUSE_SWEEP.flops },
+		{ "project", projectMs, projectSweepCells * PROJECT_SWEEP.bytes + projectCallCells * PROJECT_ONCE.bytes,
+			projectSweepCells * PROJECT_SWEEP.flops + projectCallCells * PROJECT_ONCE.flops },
+		{ "advect", advectMs, advectCells * ADVECT.bytes, advectCells * ADVECT.flops }
+	};
+
+	BenchmarkReport report;
+	report.setInfo("n", N);
+	report.setInfo("steps", steps);
+	report.setMetric("roofline.peak_memory_gbs", peaks.memoryGBs);
+	report.setMetric("roofline.peak_field_gbs", peaks.fieldGBs);
+	report.setMetric("roofline.peak_gflops", peaks.gflops);
+
+	// The field-sized triad is the bandwidth ceiling: the fields of an N^2 run
+	// live wherever its triad's arrays did.
+	double ridge = peaks.gflops / peaks.fieldGBs;
+	std::cout << "ridge point " << ridge << " flop/byte" << std::endl;
+	std::cout << std::left << std::setw(10) << "stage" << std::right << std::setw(10) << "ms/step" << std::setw(10) << "flop/B"
+		<< std::setw(10) << "GB/s" << std::setw(10) << "GFLOP/s" << std::setw(9) << "bound" << std::setw(11) << "% of roof" << std::endl;
+	for (int k = 0; k < 3; k++) {
+		const Stage& s = stages[k];
+		double seconds = s.ms * 1e-3;
+		double intensity = s.flops / s.bytes;
+		double gbs = seconds > 0.0 ? s.bytes / seconds * 1e-9 : 0.0;
+		double gflops = seconds > 0.0 ? s.flops / seconds * 1e-9 : 0.0;
+		bool memoryBound = intensity < ridge;
+		double roof = std::min(peaks.gflops, intensity * peaks.fieldGBs);
+		double percent = gflops / roof * 100.0;
+
+		std::cout << std::left << std::setw(10) << s.name << std::right << std::fixed << std::setprecision(3)
+			<< std::setw(10) << s.ms / steps << std::setw(10) << intensity << std::setw(10) << gbs << std::setw(10) << gflops
+			<< std::setw(9) << (memoryBound ? "memory" : "compute") << std::setw(10) << std::setprecision(1) << percent << "%"
+			<< std::defaultfloat << std::setprecision(6) << std::endl;
+
+		std::string prefix = std::string("roofline.") + s.name;
+		report.setMetric(prefix + ".ms_per_step", s.ms / steps);
+		report.setMetric(prefix + ".flop_per_byte", intensity);
+		report.setMetric(prefix + ".gbs", gbs);
+		report.setMetric(prefix + ".gflops", gflops);
+		report.setMetric(prefix + ".memory_bound", memoryBound ? 1.0 : 0.0);
+		report.setMetric(prefix + ".percent_of_roof", percent);
+	}
+
+	if (options.jsonPath != nullptr) {
+		if (!report.write(options.jsonPath)) {
+			std::cerr << "could not write " << options.jsonPath << std::endl;
+			return 1;
+		}
+		std::cout << "results written to " << options.jsonPath << std::endl;
+	}
+	return 0;
+}
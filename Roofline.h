@@ -0,0 +1,21 @@
+#pragma once
+
+// Peak rates of one core, measured at startup. --roofline runs the solver on
+// one OpenMP thread as well, so single-thread peaks are its ceilings.
+struct MachinePeaks {
+	// STREAM triad on arrays too large for any cache
+	double memoryGBs;
+	// STREAM triad on arrays the size of one solver field
+	double fieldGBs;
+	// independent multiply-add chains, as far as the compiler vectorises them
+	double gflops;
+};
+
+// fieldFloats: floats per solver field, for the working-set-sized triad.
+MachinePeaks calibratePeaks(int fieldFloats);
+
+// `--roofline [N] [steps] [--json <path>]`: runs an N x N domain with every
+// tile active on one thread and places the diffuse, project and advect
+// stages on the roofline of this machine, using the per-cell traffic and
+// flop model in Roofline.cpp.
+int runRoofline(int argc, char** argv);
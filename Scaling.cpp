@@ -0,0 +1,166 @@
+#include "Scaling.h"
+#include "Benchmark.h"
+#include "BenchmarkReport.h"
+#include "Fluidsim.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+static const int SCALING_REPEATS = 5;
+static const int WARMUP_STEPS = 3;
+static const int MIN_SIZE = 128;
+static const int MAX_SIZE = 8192;
+
+static int maxThreads() {
+#ifdef _OPENMP
+	return omp_get_num_procs();
+#else
+	return 1;
+#endif
+}
+
+// Pins OpenMP thread k of a team of `threads` to processor k, so repeats do
+// not migrate between cores. The runtime reuses the same pool threads for
+// later parallel regions of that size.
+static void pinThreads(int threads) {
+#ifdef _OPENMP
+	omp_set_num_threads(threads);
+#pragma omp parallel
+	{
+		int cpu = omp_get_thread_num() % omp_get_num_procs();
+#ifdef _WIN32
+		SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu);
+#elif defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+		(void)cpu;
+#endif
+	}
+#else
+	(void)threads;
+#endif
+}
+
+struct ScalingResult {
+	double meanMs;
+	double stddevMs;
+};
+
+static ScalingResult timeConfiguration(int N, int threads, int steps) {
+	pinThreads(threads);
+	Fluidsim sim(N);
+	addSwirl(sim);
+	for (int i = 0; i < WARMUP_STEPS; i++) {
+		sim.step();
+	}
+
+	double samples[SCALING_REPEATS];
+	for (int r = 0; r < SCALING_REPEATS; r++) {
+		auto t0 = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < steps; i++) {
+			sim.step();
+		}
+		auto t1 = std::chrono::high_resolution_clock::now();
+		samples[r] = std::chrono::duration<double, std::milli>(t1 - t0).count() / steps;
+	}
+
+	ScalingResult result;
+	double sum = 0.0;
+	for (int r = 0; r < SCALING_REPEATS; r++) sum += samples[r];
+	result.meanMs = sum / SCALING_REPEATS;
+	double var = 0.0;
+	for (int r = 0; r < SCALING_REPEATS; r++) var += (samples[r] - result.meanMs) * (samples[r] - result.meanMs);
+	result.stddevMs = std::sqrt(var / (SCALING_REPEATS - 1));
+	return result;
+}
+
+int runScaling(int argc, char** argv) {
+	BenchmarkOptions options(1024, 5);
+	if (!parseBenchmarkOptions(argc, argv, options)) return 1;
+	int maxN = std::min(std::max(options.N, MIN_SIZE), MAX_SIZE);
+	int steps = options.steps;
+
+	std::vector<int> threadCounts;
+	int processors = maxThreads();
+	for (int t = 1; t < processors; t *= 2) threadCounts.push_back(t);
+	threadCounts.push_back(processors);
+
+	BenchmarkReport report;
+	report.setInfo("max_n", maxN);
+	report.setInfo("steps", steps);
+	report.setInfo("repeats", SCALING_REPEATS);
+	report.setInfo("processors", processors);
+
+	std::ofstream csv;
+	if (options.csvPath != nullptr) {
+		csv.open(options.csvPath);
+		if (!csv) {
+			std::cerr << "could not write " << options.csvPath << std::endl;
+			return 1;
+		}
+		csv << "mode,n,threads,mean_ms,stddev_ms,speedup,efficiency" << std::endl;
+	}
+
+	std::cout << processors << " processors, " << SCALING_REPEATS << " repeats of " << steps << " steps" << std::endl;
+	for (int weak = 0; weak <= 1; weak++) {
+		const char* mode = weak ? "weak" : "strong";
+		std::cout << (weak ? "weak scaling (" : "strong scaling (") << (weak ? "128^2 cells per thread" : "fixed N")
+			<< "; ms/step, stddev, speedup, efficiency):" << std::endl;
+
+		for (int base = MIN_SIZE; base <= maxN; base *= 2) {
+			double oneThreadMs = 0.0;
+			for (size_t k = 0; k < threadCounts.size(); k++) {
+				int threads = threadCounts[k];
+				int N = base;
+				if (weak) {
+					// whole tiles, so every thread count covers whole-tile work
+					N = (int)std::lround(base * std::sqrt((double)threads) / Fluidsim::TILE_SIZE) * Fluidsim::TILE_SIZE;
+				}
+				ScalingResult r = timeConfiguration(N, threads, steps);
+				if (k == 0) oneThreadMs = r.meanMs;
+				// weak: scaled speedup, threads times the one-thread rate per cell
+				double efficiency = weak ? oneThreadMs / r.meanMs : oneThreadMs / r.meanMs / threads;
+				double speedup = efficiency * threads;
+
+				std::cout << "  N = " << N << ", " << threads << " threads: " << r.meanMs << " +- " << r.stddevMs << ", "
+					<< speedup << "x, " << efficiency * 100.0 << " %" << std::endl;
+				if (csv.is_open()) {
+					csv << mode << "," << N << "," << threads << "," << r.meanMs << "," << r.stddevMs << "," << speedup << "," << efficiency << std::endl;
+				}
+				std::string prefix = std::string("scaling.") + mode + ".n" + std::to_string(base) + ".t" + std::to_string(threads);
+				report.setMetric(prefix + ".ms", r.meanMs);
+				report.setMetric(prefix + ".stddev_ms", r.stddevMs);
+				report.setMetric(prefix + ".speedup", speedup);
+				report.setMetric(prefix + ".efficiency", efficiency);
+			}
+			// one weak series per base size would repeat the same question
+			if (weak) break;
+		}
+	}
+
+	if (options.jsonPath != nullptr) {
+		if (!report.write(options.jsonPath)) {
+			std::cerr << "could not write " << options.jsonPath << std::endl;
+			return 1;
+		}
+		std::cout << "results written to " << options.jsonPath << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+// `--scaling [maxN] [steps] [--json <path>] [--csv <path>]`: times
+// Fluidsim::step() on a fully active domain for OpenMP thread counts from 1
+// to the number of processors.
+//
+// Strong scaling keeps N fixed, for N = 128, 256, ... maxN (default 1024).
+// Weak scaling keeps N^2 per thread at 128^2, so N grows with sqrt(threads).
+// Every configuration gets warm-up steps and SCALING_REPEATS timed repeats;
+// the mean and standard deviation of ms/step are reported with speedup and
+// efficiency against one thread. Threads are pinned to cores where the
+// platform allows it.
+int runScaling(int argc, char** argv);
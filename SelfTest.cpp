@@ -0,0 +1,463 @@
+#include "SelfTest.h"
+#include "Benchmark.h"
+#include "Fluidsim.h"
+#include "ReferenceFluidsim.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+static const int KERNEL_TRIALS = 24;
+static const int RUN_STEPS = 100;
+static const int DETERMINISM_STEPS = 60;
+
+// Bounds on the error relative to the largest reference value. The kernels
+// do the same arithmetic in the same order as the reference, so they must
+// agree to rounding. Multi-step runs add the effect of skipped tiles (cells
+// the reference updates to tiny values).
+static const double KERNEL_MAX = 1e-5, KERNEL_RMS = 1e-6;
+static const double RUN_MAX = 1e-3, RUN_RMS = 1e-4;
+static const double GOLDEN_MAX = 1e-4, GOLDEN_RMS = 1e-5;
+
+int runSelfTest(int argc, char** argv) {
+	return SelfTest::run(argc, argv);
+}
+
+SelfTest::Error SelfTest::compare(const float* ref, const float* test, int count) {
+	double scale = 0.0;
+	for (int i = 0; i < count; i++) scale = std::max(scale, (double)std::fabs(ref[i]));
+	if (scale == 0.0) scale = 1.0;
+
+	Error e = { 0.0, 0.0 };
+	for (int i = 0; i < count; i++) {
+		double d = std::fabs((double)ref[i] - test[i]);
+		// a NaN anywhere must fail, and comparisons with NaN are false
+		if (!(d <= e.max)) e.max = d;
+		e.rms += d * d;
+	}
+	e.max /= scale;
+	e.rms = std::sqrt(e.rms / std::max(count, 1)) / scale;
+	return e;
+}
+
+bool SelfTest::report(const char* name, const Error& e, double maxBound, double rmsBound) {
+	bool pass = e.max <= maxBound && e.rms <= rmsBound;
+	std::printf("  %-28s max %.3e (<= %.0e)  rms %.3e (<= %.0e)  %s\n", name, e.max, maxBound, e.rms, rmsBound, pass ? "ok" : "FAIL");
+	return pass;
+}
+
+
+void SelfTest::keepWorst(Error& worst, const Error& e) {
+	if (!(e.max <= worst.max)) worst.max = e.max;
+	if (!(e.rms <= worst.rms)) worst.rms = e.rms;
+}
+
+void SelfTest::loadMasks(const Fluidsim& sim, ReferenceFluidsim& ref) {
+	int size = (sim.Nx + 2) * (sim.Ny + 2);
+	ref.fluid.assign(sim.fluid, sim.fluid + size);
+	ref.solidVx.assign(sim.solidVx, sim.solidVx + size);
+	ref.solidVy.assign(sim.solidVy, sim.solidVy + size);
+	ref.updateCoefficients();
+}
+
+// Random grid shapes (including partial edge tiles), cell aspect ratios,
+// obstacles and wall velocities; every tile is active, as after construction.
+bool SelfTest::checkKernels() {
+	std::printf("kernels (%d random cases, vs reference):\n", KERNEL_TRIALS);
+	Error worstBnd = { 0, 0 }, worstCoeff = { 0, 0 }, worstDiffuse = { 0, 0 }, worstProject = { 0, 0 }, worstAdvect = { 0, 0 };
+
+	for (int trial = 0; trial < KERNEL_TRIALS; trial++) {
+		std::mt19937 rng(1234 + trial);
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		int Nx = 16 + (int)(rng() % 81);
+		int Ny = 16 + (int)(rng() % 81);
+		float hx = 1.0f / std::max(Nx, Ny);
+		float hy = hx * std::pow(2.0f, unit(rng));
+		float dt = 0.1f;
+
+		Fluidsim sim(Nx, Ny, hx, hy);
+		int rects = (int)(rng() % 4);
+		for (int k = 0; k < rects; k++) {
+			int x0 = 1 + (int)(rng() % Nx), y0 = 1 + (int)(rng() % Ny);
+			sim.addObstacleRect(x0, y0, x0 + (int)(rng() % 12), y0 + (int)(rng() % 12));
+		}
+		sim.addObstacleCircle(1 + (int)(rng() % Nx), 1 + (int)(rng() % Ny), 2 + (int)(rng() % 6));
+
+		int size = (Nx + 2) * (Ny + 2);
+		float speedX = 3.0f * hx / dt, speedY = 3.0f * hy / dt;
+		for (int i = 0; i < size; i++) {
+			if (sim.fluid[i] < 0.5f) {
+				sim.solidVx[i] = 0.2f * speedX * unit(rng);
+				sim.solidVy[i] = 0.2f * speedY * unit(rng);
+			}
+		}
+		ReferenceFluidsim ref(Nx, Ny, hx, hy);
+		loadMasks(sim, ref);
+		// the coefficients are only defined (and read) inside the ghost ring
+		for (int j = 1; j <= Ny; j++) {
+			int row = j * (Nx + 2) + 1;
+			keepWorst(worstCoeff, compare(ref.fluidNbrX.data() + row, sim.fluidNbrX + row, Nx));
+			keepWorst(worstCoeff, compare(ref.fluidNbrY.data() + row, sim.fluidNbrY + row, Nx));
+			keepWorst(worstCoeff, compare(ref.invFluidNbr.data() + row, sim.invFluidNbr + row, Nx));
+		}
+
+		std::vector<float> a(size), b(size), u(size), v(size);
+		for (int i = 0; i < size; i++) {
+			a[i] = unit(rng);
+			b[i] = unit(rng);
+			u[i] = speedX * unit(rng);
+			v[i] = speedY * unit(rng);
+		}
+
+		for (int bnd = 0; bnd <= 2; bnd++) {
+			std::vector<float> expected = a;
+			std::copy(a.begin(), a.end(), sim.s);
+			ref.set_bnd(bnd, expected.data());
+			sim.set_bnd(bnd, sim.s);
+			keepWorst(worstBnd, compare(expected.data(), sim.s, size));
+
+			// a = dt * diff / h^2 up to 2, well past the explicit limit
+			float diff = 2.0f * std::fabs(unit(rng)) * hx * hx / dt;
+			expected = a;
+			std::copy(a.begin(), a.end(), sim.s);
+			std::copy(b.begin(), b.end(), sim.density);
+			ref.diffuse(bnd, expected.data(), b.data(), diff, dt, sim.quality.diffuseIterations);
+			sim.diffuse(bnd, sim.s, sim.density, diff, dt);
+			keepWorst(worstDiffuse, compare(expected.data(), sim.s, size));
+
+			expected = a;
+			std::copy(a.begin(), a.end(), sim.s);
+			std::copy(u.begin(), u.end(), sim.vx);
+			std::copy(v.begin(), v.end(), sim.vy);
+			ref.advect(bnd, expected.data(), b.data(), u.data(), v.data(), dt);
+			sim.advect(bnd, sim.s, sim.density, sim.vx, sim.vy, dt);
+			keepWorst(worstAdvect, compare(expected.data(), sim.s, size));
+		}
+
+		std::vector<float> refU = u, refV = v, refP = a, refDiv = b;
+		std::copy(u.begin(), u.end(), sim.vx);
+		std::copy(v.begin(), v.end(), sim.vy);
+		std::copy(a.begin(), a.end(), sim.vx0);
+		std::copy(b.begin(), b.end(), sim.vy0);
+		ref.project(refU.data(), refV.data(), refP.data(), refDiv.data(), sim.quality.projectIterations);
+		sim.project(sim.vx, sim.vy, sim.vx0, sim.vy0);
+		keepWorst(worstProject, compare(refU.data(), sim.vx, size));
+		keepWorst(worstProject, compare(refV.data(), sim.vy, size));
+		keepWorst(worstProject, compare(refP.data(), sim.vx0, size));
+	}
+
+	bool pass = report("obstacle coefficients", worstCoeff, KERNEL_MAX, KERNEL_RMS);
+	pass &= report("set_bnd", worstBnd, KERNEL_MAX, KERNEL_RMS);
+	pass &= report("diffuse", worstDiffuse, KERNEL_MAX, KERNEL_RMS);
+	pass &= report("project", worstProject, KERNEL_MAX, KERNEL_RMS);
+	pass &= report("advect", worstAdvect, KERNEL_MAX, KERNEL_RMS);
+	return pass;
+}
+
+static void addPlume(Fluidsim& sim, ReferenceFluidsim& ref, int x, int y, float density, float vx, float vy) {
+	for (int j = y - 1; j <= y + 1; j++) {
+		for (int i = x - 1; i <= x + 1; i++) {
+			sim.addDensity(i, j, density);
+			sim.addVelocity(i, j, vx, vy);
+			ref.density[ref.index(i, j)] += density;
+			ref.vx[ref.index(i, j)] += vx;
+			ref.vy[ref.index(i, j)] += vy;
+		}
+	}
+}
+
+bool SelfTest::checkRuns() {
+	std::printf("runs (%d steps, vs reference steps):\n", RUN_STEPS);
+	bool pass = true;
+
+	// A plume past obstacles in a wide domain, so most tiles stay inactive.
+	{
+		const int Nx = 192, Ny = 128;
+		Fluidsim sim(Nx, Ny);
+		sim.addObstacleRect(40, 52, 44, 76);
+		sim.addObstacleCircle(70, 60, 6);
+		ReferenceFluidsim ref(Nx, Ny, 1.0f / Nx, 1.0f / Nx);
+		loadMasks(sim, ref);
+
+		Error density = { 0, 0 }, velocity = { 0, 0 };
+		double activeFraction = 0.0;
+		int size = (Nx + 2) * (Ny + 2);
+		for (int step = 0; step < RUN_STEPS; step++) {
+			addPlume(sim, ref, 12, 64, 20.0f, 0.04f, 0.005f * std::sin(step * 0.2f));
+			sim.step();
+			ref.step(sim.getTimeStep(), 0.0f, 0.0f, sim.quality.diffuseIterations);
+			keepWorst(density, compare(ref.density.data(), sim.density, size));
+			keepWorst(velocity, compare(ref.vx.data(), sim.vx, size));
+			keepWorst(velocity, compare(ref.vy.data(), sim.vy, size));
+			activeFraction += (double)sim.getActiveTileCount() / (sim.getTilesX() * sim.getTilesY());
+		}
+		std::printf("  Fluidsim, %.0f %% of tiles active on average:\n", activeFraction / RUN_STEPS * 100.0);
+		pass &= report("tiled density", density, RUN_MAX, RUN_RMS);
+		pass &= report("tiled velocity", velocity, RUN_MAX, RUN_RMS);
+	}
+
+	// A perturbed shear layer and its transpose through the reference steps.
+	// With square cells the two runs must stay transposes of each other, which
+	// fails if one velocity component is backtraced with anything but its own
+	// field (the goldens alone would lock such a call in). The sweeps run to
+	// convergence so their order does not break the symmetry.
+	{
+		const int N = 32, steps = 5, iterations = 400;
+		const float h = 1.0f / N, dt = 3.0f * h;
+		ReferenceFluidsim ref(N, N, h, h), transposed(N, N, h, h);
+		for (int j = 1; j <= N; j++) {
+			for (int i = 1; i <= N; i++) {
+				float vx = 0.5f * std::tanh((j - 0.5f * N) / 3.0f);
+				float vy = 0.05f * std::sin(6.2831853f * i / N);
+				float density = (std::abs(i - 10) < 4 && std::abs(j - 20) < 4) ? 1.0f : 0.0f;
+				ref.vx[ref.index(i, j)] = vx;
+				ref.vy[ref.index(i, j)] = vy;
+				ref.density[ref.index(i, j)] = density;
+				transposed.vx[ref.index(j, i)] = vy;
+				transposed.vy[ref.index(j, i)] = vx;
+				transposed.density[ref.index(j, i)] = density;
+			}
+		}
+		for (int step = 0; step < steps; step++) {
+			ref.step(dt, 0.0f, 0.0f, iterations);
+			transposed.step(dt, 0.0f, 0.0f, iterations);
+		}
+		std::vector<float> vx(ref.vx.size()), vy(ref.vy.size()), density(ref.density.size());
+		for (int j = 0; j <= N + 1; j++) {
+			for (int i = 0; i <= N + 1; i++) {
+				vx[ref.index(i, j)] = transposed.vy[ref.index(j, i)];
+				vy[ref.index(i, j)] = transposed.vx[ref.index(j, i)];
+				density[ref.index(i, j)] = transposed.density[ref.index(j, i)];
+			}
+		}
+		int size = (N + 2) * (N + 2);
+		Error velocity = compare(ref.vx.data(), vx.data(), size);
+		keepWorst(velocity, compare(ref.vy.data(), vy.data(), size));
+		std::printf("  reference, shear layer vs its transpose:\n");
+		pass &= report("shear velocity", velocity, RUN_MAX, RUN_RMS);
+		pass &= report("shear density", compare(ref.density.data(), density.data(), size), RUN_MAX, RUN_RMS);
+	}
+
+	return pass;
+}
+
+// A plume past an obstacle on a grid with a partial edge tile, with a given
+// number of OpenMP threads; returns density, vx and vy back to back.
+static std::vector<float> deterministicRun(int threads, bool deterministic) {
+#ifdef _OPENMP
+	omp_set_num_threads(threads);
+#else
+	(void)threads;
+#endif
+	const int Nx = 120, Ny = 88;
+	Fluidsim sim(Nx, Ny);
+	sim.setDeterministic(deterministic);
+	sim.addObstacleCircle(60, 44, 7);
+	for (int step = 0; step < DETERMINISM_STEPS; step++) {
+		for (int j = 42; j <= 46; j++) {
+			sim.addDensity(8, j, 20.0f);
+			sim.addVelocity(8, j, 0.05f, 0.01f * std::sin(step * 0.3f));
+		}
+		sim.step();
+	}
+	int size = (Nx + 2) * (Ny + 2);
+	std::vector<float> state(sim.getDensityArray(), sim.getDensityArray() + size);
+	state.insert(state.end(), sim.getVelocityXArray(), sim.getVelocityXArray() + size);
+	state.insert(state.end(), sim.getVelocityYArray(), sim.getVelocityYArray() + size);
+	return state;
+}
+
+// Deterministic mode must give the same bits for every thread count (the
+// machine need not have that many processors). The default mode is shown
+// for comparison only.
+bool SelfTest::checkDeterminism() {
+	const int threadCounts[] = { 1, 2, 3, 8 };
+	std::printf("determinism (%d steps, vs 1 thread):\n", DETERMINISM_STEPS);
+	bool pass = true;
+	for (int mode = 1; mode >= 0; mode--) {
+		std::vector<float> one = deterministicRun(1, mode == 1);
+		for (int t = 1; t < 4; t++) {
+			std::vector<float> other = deterministicRun(threadCounts[t], mode == 1);
+			bool same = std::memcmp(one.data(), other.data(), one.size() * sizeof(float)) == 0;
+			Error e = compare(one.data(), other.data(), (int)one.size());
+			std::printf("  %-13s %d threads: max %.3e  rms %.3e  %s\n", mode ? "deterministic" : "default", threadCounts[t], e.max, e.rms,
+				same ? "bitwise equal" : (mode ? "FAIL" : "differs"));
+			if (mode == 1) pass &= same;
+		}
+	}
+	return pass;
+}
+
+// Block means of the interior of a field with a ghost ring, blocks x blocks.
+static void blockMeans(const float* field, int Nx, int Ny, int blocks, std::vector<float>& out) {
+	out.assign((size_t)blocks * blocks, 0.0f);
+	for (int j = 1; j <= Ny; j++) {
+		for (int i = 1; i <= Nx; i++) {
+			int b = (i - 1) * blocks / Nx + ((j - 1) * blocks / Ny) * blocks;
+			out[b] += field[i + j * (Nx + 2)];
+		}
+	}
+	float cellsPerBlock = (float)Nx * Ny / (blocks * blocks);
+	for (size_t b = 0; b < out.size(); b++) out[b] /= cellsPerBlock;
+}
+
+struct Snapshot {
+	std::vector<std::string> names;
+	std::vector<std::vector<float> > fields;
+};
+
+static const int SNAPSHOT_BLOCKS = 8;
+
+static void snapshotOf(Fluidsim& sim, Snapshot& snap) {
+	int Nx = sim.getWidth(), Ny = sim.getHeight();
+	const char* names[3] = { "density", "vx", "vy" };
+	float* fields[3] = { sim.getDensityArray(), sim.getVelocityXArray(), sim.getVelocityYArray() };
+	for (int f = 0; f < 3; f++) {
+		snap.names.push_back(names[f]);
+		snap.fields.push_back(std::vector<float>());
+		blockMeans(fields[f], Nx, Ny, SNAPSHOT_BLOCKS, snap.fields.back());
+	}
+	if (sim.getDensityResolution() > 1) {
+		int r = sim.getDensityResolution();
+		snap.names.push_back("fine_density");
+		snap.fields.push_back(std::vector<float>());
+		blockMeans(sim.getFineDensityArray(), Nx * r, Ny * r, SNAPSHOT_BLOCKS * r, snap.fields.back());
+	}
+}
+
+// The fixed scenarios; changing one invalidates its snapshot.
+static const int GOLDEN_SCENARIOS = 3;
+static const char* goldenNames[GOLDEN_SCENARIOS] = { "plume", "swirl_anisotropic", "dual_density" };
+
+static void runScenario(int k, Snapshot& snap) {
+	if (k == 0) {
+		Fluidsim sim(64);
+		sim.addObstacleCircle(32, 40, 6);
+		for (int step = 0; step < 80; step++) {
+			for (int i = 31; i <= 33; i++) {
+				sim.addDensity(i, 8, 40.0f);
+				sim.addVelocity(i, 8, 0.0f, 0.05f);
+			}
+			sim.step();
+		}
+		snapshotOf(sim, snap);
+	}
+	else if (k == 1) {
+		Fluidsim sim(48, 32, 1.0f / 48, 1.5f / 48);
+		addSwirl(sim);
+		for (int step = 0; step < 40; step++) {
+			sim.step();
+		}
+		snapshotOf(sim, snap);
+	}
+	else {
+		Fluidsim sim(32);
+		sim.setDensityResolution(2);
+		for (int step = 0; step < 60; step++) {
+			sim.addDensity(16, 6, 30.0f);
+			sim.addVelocity(16, 6, 0.01f, 0.06f);
+			sim.step();
+		}
+		snapshotOf(sim, snap);
+	}
+}
+
+static bool writeSnapshot(const std::string& path, const Snapshot& snap) {
+	std::ofstream out(path.c_str());
+	if (!out) return false;
+	char value[32];
+	for (size_t f = 0; f < snap.fields.size(); f++) {
+		out << "field " << snap.names[f] << " " << snap.fields[f].size() << "\n";
+		for (size_t i = 0; i < snap.fields[f].size(); i++) {
+			std::snprintf(value, sizeof(value), "%.9g", snap.fields[f][i]);
+			out << value << ((i + 1) % SNAPSHOT_BLOCKS == 0 ? "\n" : " ");
+		}
+	}
+	return (bool)out;
+}
+
+static bool readSnapshot(const std::string& path, Snapshot& snap) {
+	std::ifstream in(path.c_str());
+	std::string keyword;
+	while (in >> keyword) {
+		std::string name;
+		size_t count;
+		if (keyword != "field" || !(in >> name >> count)) return false;
+		snap.names.push_back(name);
+		snap.fields.push_back(std::vector<float>(count));
+		for (size_t i = 0; i < count; i++) {
+			if (!(in >> snap.fields.back()[i])) return false;
+		}
+	}
+	return !snap.fields.empty();
+}
+
+bool SelfTest::checkGolden(const char* dir, bool update) {
+	std::printf("golden snapshots (%s):\n", dir);
+	bool pass = true;
+	for (int k = 0; k < GOLDEN_SCENARIOS; k++) {
+		std::string path = std::string(dir) + "/" + goldenNames[k] + ".txt";
+		Snapshot current;
+		runScenario(k, current);
+		if (update) {
+			bool written = writeSnapshot(path, current);
+			std::printf("  %-28s %s\n", goldenNames[k], written ? "written" : "could not write");
+			pass &= written;
+			continue;
+		}
+
+		Snapshot golden;
+		if (!readSnapshot(path, golden) || golden.names != current.names) {
+			std::printf("  %-28s missing or stale snapshot %s  FAIL\n", goldenNames[k], path.c_str());
+			pass = false;
+			continue;
+		}
+		for (size_t f = 0; f < golden.fields.size(); f++) {
+			std::string name = std::string(goldenNames[k]) + "/" + golden.names[f];
+			if (golden.fields[f].size() != current.fields[f].size()) {
+				std::printf("  %-28s size mismatch  FAIL\n", name.c_str());
+				pass = false;
+				continue;
+			}
+			pass &= report(name.c_str(), compare(golden.fields[f].data(), current.fields[f].data(), (int)golden.fields[f].size()), GOLDEN_MAX, GOLDEN_RMS);
+		}
+	}
+	return pass;
+}
+
+int SelfTest::run(int argc, char** argv) {
+	const char* goldenDir = "golden";
+	bool update = false;
+	for (int i = 2; i < argc; i++) {
+		if (std::strcmp(argv[i], "--golden") == 0 && i + 1 < argc) goldenDir = argv[++i];
+		else if (std::strcmp(argv[i], "--update-golden") == 0) update = true;
+		else {
+			std::cerr << "usage: --selftest [--golden <dir>] [--update-golden]" << std::endl;
+			return 1;
+		}
+	}
+
+	// The reference sweeps rows serially, as Fluidsim does on one thread.
+#ifdef _OPENMP
+	int threads = omp_get_max_threads();
+	omp_set_num_threads(1);
+#endif
+	bool pass = checkKernels();
+	pass &= checkRuns();
+	pass &= checkGolden(goldenDir, update);
+	pass &= checkDeterminism();
+#ifdef _OPENMP
+	omp_set_num_threads(threads);
+#endif
+	std::printf("%s\n", pass ? "selftest passed" : "selftest FAILED");
+	return pass ? 0 : 1;
+}
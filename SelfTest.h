@@ -0,0 +1,45 @@
+#pragma once
+
+// `--selftest [--golden <dir>] [--update-golden]`: checks the solver against
+// ReferenceFluidsim and against stored snapshots.
+//
+//  - kernels: set_bnd, diffuse, project and advect of Fluidsim run on random
+//    fields, grid shapes, cell aspect ratios, obstacles and wall velocities,
+//    and are compared with the reference on identical inputs.
+//  - runs: many-step runs of Fluidsim with active tiles against reference
+//    steps, and reference steps of a shear layer against its transpose.
+//  - golden: fixed scenarios compared with snapshots in <dir> (default
+//    "golden"); --update-golden rewrites them.
+//  - determinism: Fluidsim::setDeterministic runs on 1, 2, 3 and 8 threads
+//    must agree bit for bit.
+//
+// The reference comparisons run on one OpenMP thread. Each check prints its
+// max and RMS error, relative to the largest reference value, against its
+// bound. Exit status 1 if any check fails.
+int runSelfTest(int argc, char** argv);
+
+class Fluidsim;
+class ReferenceFluidsim;
+
+class SelfTest {
+public:
+	static int run(int argc, char** argv);
+
+private:
+	struct Error {
+		double max;
+		double rms;
+	};
+
+	static Error compare(const float* ref, const float* test, int count);
+	static void keepWorst(Error& worst, const Error& e);
+	static bool report(const char* name, const Error& e, double maxBound, double rmsBound);
+
+	static bool checkKernels();
+	static bool checkRuns();
+	static bool checkGolden(const char* dir, bool update);
+	static bool checkDeterminism();
+
+	// copies Fluidsim's masks and wall velocities into the reference
+	static void loadMasks(const Fluidsim& sim, ReferenceFluidsim& ref);
+};
@@ -0,0 +1,120 @@
+#include "SimulationThread.h"
+#include "Fluidsim.h"
+#include "ResolutionGovernor.h"
+#include "QualityGovernor.h"
+#include "Profiler.h"
+#include <chrono>
+
+FrameExchange::FrameExchange() {
+	this->back = 0;
+	this->middle.store(1);
+	this->front = 2;
+	for (int i = 0; i < 3; i++) {
+		buffers[i].stepIndex = -1;
+		buffers[i].width = buffers[i].height = 0;
+		buffers[i].tilesX = buffers[i].tilesY = 0;
+	}
+}
+
+SimFrame& FrameExchange::writeBuffer() {
+	return buffers[back];
+}
+
+void FrameExchange::publish() {
+	back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+}
+
+const SimFrame& FrameExchange::acquire() {
+	if (middle.load(std::memory_order_relaxed) & FRESH) {
+		front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+	}
+	return buffers[front];
+}
+
+bool FrameExchange::hasNewFrame() const {
+	return (middle.load(std::memory_order_relaxed) & FRESH) != 0;
+}
+
+SimulationThread::SimulationThread(Fluidsim* sim, float stepsPerSecond) {
+	this->sim = sim;
+	this->targetRate = stepsPerSecond;
+	this->governor = nullptr;
+	this->quality = nullptr;
+	this->running.store(false);
+	this->measuredRate.store(0.0f);
+	this->lastStepMs.store(0.0f);
+}
+
+SimulationThread::~SimulationThread() {
+	stop();
+}
+
+void SimulationThread::start() {
+	if (running.exchange(true)) return;
+	worker = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::stop() {
+	if (!running.exchange(false)) return;
+	worker.join();
+}
+
+void SimulationThread::run() {
+	typedef std::chrono::steady_clock Clock;
+	const Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / targetRate));
+
+	long long stepIndex = 0;
+	int stepsInWindow = 0;
+	Clock::time_point windowStart = Clock::now();
+	Clock::time_point nextTick = windowStart;
+	Profiler::setThreadName("simulation");
+
+	while (running.load()) {
+		Clock::time_point start = Clock::now();
+		sim->advance(sim->getTimeStep());
+
+		int cells = (sim->getWidth() + 2) * (sim->getHeight() + 2);
+		int r = sim->getDensityResolution();
+		int densityCells = (sim->getWidth() * r + 2) * (sim->getHeight() * r + 2);
+		{
+			PROFILE_SCOPE("publish");
+			SimFrame& frame = exchange.writeBuffer();
+			frame.width = sim->getWidth();
+			frame.height = sim->getHeight();
+			frame.tilesX = sim->getTilesX();
+			frame.tilesY = sim->getTilesY();
+			frame.density.assign(sim->getFineDensityArray(), sim->getFineDensityArray() + densityCells);
+			frame.fluidMask.assign(sim->getFluidMask(), sim->getFluidMask() + cells);
+			frame.activeTiles.assign(sim->getActiveTiles(), sim->getActiveTiles() + sim->getTilesX() * sim->getTilesY());
+			frame.stepIndex = stepIndex++;
+			exchange.publish();
+		}
+		lastStepMs.store(std::chrono::duration<float, std::milli>(Clock::now() - start).count());
+
+		// The solver time alone, so copying frames does not count against the budget.
+		if (quality != nullptr && quality->update(sim->getLastStageTimes(), sim->getLastFrameMs(), sim->getLastSubsteps())) {
+			sim->setQuality(quality->getQuality());
+		}
+		if (governor != nullptr && governor->update(sim->getLastFrameMs())) {
+			sim->resize(governor->getWidth(), governor->getHeight());
+		}
+
+		stepsInWindow++;
+		double elapsed = std::chrono::duration<double>(Clock::now() - windowStart).count();
+		if (elapsed >= 0.5) {
+			measuredRate.store((float)(stepsInWindow / elapsed));
+			stepsInWindow = 0;
+			windowStart = Clock::now();
+		}
+
+		// Fixed rate; when a step overruns, drop the debt rather than bursting to catch up.
+		nextTick += period;
+		Clock::time_point now = Clock::now();
+		if (nextTick < now) {
+			nextTick = now;
+		}
+		else {
+			std::this_thread::sleep_until(nextTick);
+		}
+	}
+}
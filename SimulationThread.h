@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+class Fluidsim;
+class ResolutionGovernor;
+class QualityGovernor;
+
+// A finished frame as published by the simulation thread.
+struct SimFrame {
+	// grid size and tile layout this frame was produced at
+	int width;
+	int height;
+	int tilesX;
+	int tilesY;
+	// at the simulation's density resolution (see Fluidsim::getFineDensityArray)
+	std::vector<float> density;
+	std::vector<float> fluidMask;
+	std::vector<unsigned char> activeTiles;
+	long long stepIndex;
+};
+
+// Single-producer/single-consumer triple buffer. The writer always has a free
+// slot to fill and the reader always gets the newest complete frame; neither
+// side ever waits for the other.
+class FrameExchange {
+public:
+	FrameExchange();
+
+	SimFrame& writeBuffer();
+	void publish();
+
+	// Returns the newest published frame (the same one again if nothing new arrived).
+	const SimFrame& acquire();
+	bool hasNewFrame() const;
+
+private:
+	static const int FRESH = 4;
+	static const int INDEX_MASK = 3;
+
+	SimFrame buffers[3];
+	int back;
+	int front;
+	std::atomic<int> middle;
+};
+
+// Runs Fluidsim::advance at a fixed rate on its own thread and hands frames to
+// the renderer through a FrameExchange.
+class SimulationThread {
+public:
+	SimulationThread(Fluidsim* sim, float stepsPerSecond);
+	~SimulationThread();
+
+	void start();
+	void stop();
+
+	FrameExchange& frames() { return exchange; }
+
+	// Optional; when set, the grid is resized between steps to keep the step
+	// time inside the governor's budget. Call before start().
+	void setResolutionGovernor(ResolutionGovernor* governor) { this->governor = governor; }
+	// Optional; adjusts solver iterations and stages every step. It runs before
+	// the resolution governor, which then only sees what quality could not absorb.
+	void setQualityGovernor(QualityGovernor* quality) { this->quality = quality; }
+
+	float getStepsPerSecond() const { return measuredRate.load(); }
+	float getLastStepMs() const { return lastStepMs.load(); }
+
+private:
+	Fluidsim* sim;
+	float targetRate;
+	ResolutionGovernor* governor;
+	QualityGovernor* quality;
+
+	FrameExchange exchange;
+	std::thread worker;
+	std::atomic<bool> running;
+	std::atomic<float> measuredRate;
+	std::atomic<float> lastStepMs;
+
+	void run();
+};
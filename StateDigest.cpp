@@ -0,0 +1,254 @@
+#include "StateDigest.h"
+#include "Benchmark.h"
+#include "Fluidsim.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+static const uint64_t PRIME1 = 11400714785074694791ULL;
+static const uint64_t PRIME2 = 14029467366897019727ULL;
+static const uint64_t PRIME3 = 1609587929392839161ULL;
+static const uint64_t PRIME4 = 9650029242287828579ULL;
+static const uint64_t PRIME5 = 2870177450012600261ULL;
+
+static inline uint64_t rotl(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const unsigned char* p) {
+	uint64_t v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t read32(const unsigned char* p) {
+	uint32_t v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t round64(uint64_t acc, uint64_t input) {
+	acc += input * PRIME2;
+	acc = rotl(acc, 31);
+	return acc * PRIME1;
+}
+
+static inline uint64_t mergeRound(uint64_t acc, uint64_t value) {
+	acc ^= round64(0, value);
+	return acc * PRIME1 + PRIME4;
+}
+
+uint64_t hashBytes(const void* data, size_t length, uint64_t seed) {
+	const unsigned char* p = (const unsigned char*)data;
+	const unsigned char* end = p + length;
+	uint64_t h;
+
+	if (length >= 32) {
+		uint64_t v1 = seed + PRIME1 + PRIME2;
+		uint64_t v2 = seed + PRIME2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - PRIME1;
+		const unsigned char* limit = end - 32;
+		do {
+			v1 = round64(v1, read64(p));
+			v2 = round64(v2, read64(p + 8));
+			v3 = round64(v3, read64(p + 16));
+			v4 = round64(v4, read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		h = mergeRound(h, v1);
+		h = mergeRound(h, v2);
+		h = mergeRound(h, v3);
+		h = mergeRound(h, v4);
+	}
+	else {
+		h = seed + PRIME5;
+	}
+	h += (uint64_t)length;
+
+	for (; p + 8 <= end; p += 8) {
+		h ^= round64(0, read64(p));
+		h = rotl(h, 27) * PRIME1 + PRIME4;
+	}
+	if (p + 4 <= end) {
+		h ^= (uint64_t)read32(p) * PRIME1;
+		h = rotl(h, 23) * PRIME2 + PRIME3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		h ^= (*p) * PRIME5;
+		h = rotl(h, 11) * PRIME1;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME3;
+	h ^= h >> 32;
+	return h;
+}
+
+DigestLog::DigestLog() {
+	this->stageDigests = false;
+	this->step = 0;
+	this->totalMs = 0.0;
+}
+
+bool DigestLog::open(const char* path) {
+	out.open(path);
+	step = 0;
+	return out.is_open();
+}
+
+void DigestLog::close() {
+	out.close();
+}
+
+void DigestLog::record(const char* stage, size_t count, std::initializer_list<DigestField> fields) {
+	if (!out.is_open()) return;
+	auto start = std::chrono::high_resolution_clock::now();
+	char digest[24];
+	line = std::to_string(step);
+	line += ' ';
+	line += stage;
+	for (const DigestField& f : fields) {
+		std::snprintf(digest, sizeof(digest), "=%016llx", (unsigned long long)hashBytes(f.data, count * sizeof(float)));
+		line += ' ';
+		line += f.name;
+		line += digest;
+	}
+	line += '\n';
+	out << line;
+	totalMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void DigestLog::recordStep(size_t count, std::initializer_list<DigestField> fields) {
+	record("step", count, fields);
+	step++;
+}
+
+struct DigestRecord {
+	long long step;
+	std::string stage;
+	// "name=digest" tokens in the order written
+	std::vector<std::string> fields;
+};
+
+static bool readDigestLog(const char* path, std::vector<DigestRecord>& records, bool& hasStages) {
+	std::ifstream in(path);
+	if (!in) return false;
+	hasStages = false;
+	std::string line;
+	while (std::getline(in, line)) {
+		std::istringstream tokens(line);
+		DigestRecord r;
+		if (!(tokens >> r.step >> r.stage)) continue;
+		std::string field;
+		while (tokens >> field) r.fields.push_back(field);
+		if (r.stage != "step") hasStages = true;
+		records.push_back(r);
+	}
+	return true;
+}
+
+int compareDigestLogs(const char* pathA, const char* pathB) {
+	std::vector<DigestRecord> a, b;
+	bool stagesA, stagesB;
+	if (!readDigestLog(pathA, a, stagesA)) {
+		std::cerr << "could not read " << pathA << std::endl;
+		return 2;
+	}
+	if (!readDigestLog(pathB, b, stagesB)) {
+		std::cerr << "could not read " << pathB << std::endl;
+		return 2;
+	}
+	if (stagesA != stagesB) {
+		std::cout << "only one log has stage digests; comparing step records" << std::endl;
+		for (std::vector<DigestRecord>* log : { &a, &b }) {
+			std::vector<DigestRecord> steps;
+			for (const DigestRecord& r : *log) {
+				if (r.stage == "step") steps.push_back(r);
+			}
+			log->swap(steps);
+		}
+	}
+
+	size_t common = std::min(a.size(), b.size());
+	for (size_t k = 0; k < common; k++) {
+		if (a[k].step == b[k].step && a[k].stage == b[k].stage && a[k].fields == b[k].fields) continue;
+		std::cout << "first divergence at step " << a[k].step << ", stage " << a[k].stage;
+		if (a[k].step != b[k].step || a[k].stage != b[k].stage) {
+			std::cout << " (other log: step " << b[k].step << ", stage " << b[k].stage << ")" << std::endl;
+			return 1;
+		}
+		std::cout << ":";
+		for (size_t f = 0; f < std::min(a[k].fields.size(), b[k].fields.size()); f++) {
+			if (a[k].fields[f] != b[k].fields[f]) std::cout << " " << a[k].fields[f].substr(0, a[k].fields[f].find('='));
+		}
+		std::cout << std::endl;
+		return 1;
+	}
+	if (a.size() != b.size()) {
+		const char* shorter = (a.size() < b.size()) ? pathA : pathB;
+		std::cout << "identical for " << common << " records, then " << shorter << " ends" << std::endl;
+		return 1;
+	}
+	std::cout << "identical: " << a.size() << " records" << std::endl;
+	return 0;
+}
+
+int runDigest(int argc, char** argv) {
+	int positional[2] = { 1024, 10 };
+	int positionalCount = 0;
+	const char* path = "fluidsim_digest.log";
+	bool stages = false;
+	bool badArgs = false;
+	for (int i = 2; i < argc; i++) {
+		if (std::strcmp(argv[i], "--log") == 0 && i + 1 < argc) path = argv[++i];
+		else if (std::strcmp(argv[i], "--stages") == 0) stages = true;
+		else if (argv[i][0] != '-' && positionalCount < 2) positional[positionalCount++] = std::atoi(argv[i]);
+		else badArgs = true;
+	}
+	int N = positional[0];
+	int steps = positional[1];
+	if (badArgs || N < 16 || steps < 1) {
+		std::cerr << "usage: --digest [N >= 16] [steps >= 1] [--log <path>] [--stages]" << std::endl;
+		return 1;
+	}
+
+	DigestLog log;
+	log.setStageDigests(stages);
+	if (!log.open(path)) {
+		std::cerr << "could not write " << path << std::endl;
+		return 1;
+	}
+	Fluidsim sim(N);
+	sim.setDigestLog(&log);
+	addSwirl(sim);
+	double stepMs = 0.0;
+	for (int i = 0; i < steps; i++) {
+		sim.step();
+		stepMs += sim.getLastFrameMs();
+	}
+	log.close();
+
+	std::cout << "N = " << N << ", " << steps << " steps" << (stages ? ", stage digests" : "") << std::endl;
+	std::cout << "step:    " << stepMs / steps << " ms" << std::endl;
+	std::cout << "digests: " << log.getTotalMs() / steps << " ms (" << log.getTotalMs() / stepMs * 100.0 << " % of the step)" << std::endl;
+	std::cout << "log written to " << path << std::endl;
+	return 0;
+}
+
+int runDigestCompare(int argc, char** argv) {
+	if (argc != 4) {
+		std::cerr << "usage: --digest-compare <log a> <log b>" << std::endl;
+		return 2;
+	}
+	return compareDigestLogs(argv[2], argv[3]);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <initializer_list>
+#include <string>
+
+// 64-bit hash of a byte range, the XXH64 algorithm: four independent lanes
+// over 32-byte stripes, so the multiplies of neighbouring lanes overlap.
+// Byte for byte, so -0 and 0, or two NaN payloads, hash differently.
+uint64_t hashBytes(const void* data, size_t length, uint64_t seed = 0);
+
+struct DigestField {
+	const char* name;
+	const float* data;
+};
+
+// A text log of field digests, one line per record:
+//
+//   <step> <stage> <field>=<16 hex digits> ...
+//
+// Fluidsim writes a "step" record with density, vx and vy at the end of
+// every step()/advance(), and with stage digests enabled also one record
+// per solver stage (diffuse, preproject, advect, project, density) of each
+// substep, with the fields that stage wrote. Two logs of the same scenario
+// are compared with compareDigestLogs.
+class DigestLog {
+public:
+	DigestLog();
+
+	bool open(const char* path);
+	void close();
+	bool isOpen() const { return out.is_open(); }
+
+	void setStageDigests(bool enabled) { this->stageDigests = enabled; }
+	bool getStageDigests() const { return stageDigests; }
+
+	// count floats per field
+	void record(const char* stage, size_t count, std::initializer_list<DigestField> fields);
+	// Writes the "step" record and moves on to the next step number.
+	void recordStep(size_t count, std::initializer_list<DigestField> fields);
+	long long getStep() const { return step; }
+	// time spent hashing and writing since construction
+	double getTotalMs() const { return totalMs; }
+
+private:
+	std::ofstream out;
+	bool stageDigests;
+	long long step;
+	double totalMs;
+	std::string line;
+};
+
+// Prints the first record where the two logs differ (step, stage and the
+// fields whose digests differ). When only one log has stage records, just
+// the step records are compared. Returns 0 if the logs agree, 1 at a
+// divergence, 2 if a log cannot be read.
+int compareDigestLogs(const char* pathA, const char* pathB);
+
+// `--digest [N] [steps] [--log <path>] [--stages]` runs a swirl writing a
+// digest log (default fluidsim_digest.log) and reports the share of the
+// step time spent on digests; `--digest-compare <a> <b>` compares two logs.
+int runDigest(int argc, char** argv);
+int runDigestCompare(int argc, char** argv);
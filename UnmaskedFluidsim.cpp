@@ -0,0 +1,153 @@
+#include "UnmaskedFluidsim.h"
+#include <cmath>
+
+#define IX(x, y) ((x) + (y) * (N+2))
+
+UnmaskedFluidsim::UnmaskedFluidsim(int N) {
+	this->N = N;
+
+	this->dt = 0.1f;
+	this->diff = 0.0f;
+	this->visc = 0.0f;
+
+	size_t size = (size_t)(N + 2) * (N + 2);
+	s.assign(size, 0.0f);
+	density.assign(size, 0.0f);
+	vx.assign(size, 0.0f);
+	vy.assign(size, 0.0f);
+	vx0.assign(size, 0.0f);
+	vy0.assign(size, 0.0f);
+}
+
+void UnmaskedFluidsim::addDensity(int x, int y, float amount) {
+	if (x < 1 || x > N || y < 1 || y > N) return;
+	this->density[IX(x, y)] += amount;
+}
+
+void UnmaskedFluidsim::addVelocity(int x, int y, float amountX, float amountY) {
+	if (x < 1 || x > N || y < 1 || y > N) return;
+	this->vx[IX(x, y)] += amountX;
+	this->vy[IX(x, y)] += amountY;
+}
+
+// The same stage sequence as Fluidsim::step() at full quality.
+void UnmaskedFluidsim::step() {
+	diffuse(1, vx0.data(), vx.data(), visc, dt);
+	diffuse(2, vy0.data(), vy.data(), visc, dt);
+
+	project(vx0.data(), vy0.data(), vx.data(), vy.data());
+
+	advect(1, vx.data(), vx0.data(), vx0.data(), vy0.data(), dt);
+	advect(2, vy.data(), vy0.data(), vx0.data(), vy0.data(), dt);
+
+	project(vx.data(), vy.data(), vx0.data(), vy0.data());
+
+	diffuse(0, s.data(), density.data(), diff, dt);
+	advect(0, density.data(), s.data(), vx.data(), vy.data(), dt);
+
+	for (size_t i = 0; i < density.size(); i++) {
+		density[i] *= 0.995f;
+	}
+}
+
+void UnmaskedFluidsim::set_bnd(int b, float* x) {
+	for (int i = 1; i <= N; i++) {
+		x[IX(i, N + 1)] = (b == 2) ? -x[IX(i, N)] : x[IX(i, N)];
+		x[IX(i, 0)] = (b == 2) ? -x[IX(i, 1)] : x[IX(i, 1)];
+	}
+
+	for (int j = 1; j <= N; j++) {
+		x[IX(N + 1, j)] = (b == 1) ? -x[IX(N, j)] : x[IX(N, j)];
+		x[IX(0, j)] = (b == 1) ? -x[IX(1, j)] : x[IX(1, j)];
+	}
+
+	x[IX(0, 0)] = 0.5f * (x[IX(1, 0)] + x[IX(0, 1)]);
+	x[IX(N + 1, 0)] = 0.5f * (x[IX(N, 0)] + x[IX(N + 1, 1)]);
+	x[IX(0, N + 1)] = 0.5f * (x[IX(1, N + 1)] + x[IX(0, N)]);
+	x[IX(N + 1, N + 1)] = 0.5f * (x[IX(N, N + 1)] + x[IX(N + 1, N)]);
+}
+
+void UnmaskedFluidsim::advect(int b, float* d, float* d0, float* velocX, float* velocY, float dt) {
+	float i0, i1, j0, j1;
+	float s0, s1, t0, t1;
+	float tmp_x, tmp_y, Nfloat;
+
+	Nfloat = (float)N;
+
+	for (int j = 1; j <= N; j++) {
+		for (int i = 1; i <= N; i++) {
+			tmp_x = (float)i - dt * Nfloat * velocX[IX(i, j)];
+			tmp_y = (float)j - dt * Nfloat * velocY[IX(i, j)];
+
+			if (tmp_x < 0.5f) tmp_x = 0.5f;
+			if (tmp_x > Nfloat + 0.5f) tmp_x = Nfloat + 0.5f;
+			i0 = floor(tmp_x);
+			i1 = i0 + 1.0f;
+
+			if (tmp_y < 0.5f) tmp_y = 0.5f;
+			if (tmp_y > Nfloat + 0.5f) tmp_y = Nfloat + 0.5f;
+			j0 = floor(tmp_y);
+			j1 = j0 + 1.0f;
+
+			s1 = tmp_x - i0;
+			s0 = 1.0f - s1;
+			t1 = tmp_y - j0;
+			t0 = 1.0f - t1;
+
+			int i0i = (int)i0;
+			int i1i = (int)i1;
+			int j0i = (int)j0;
+			int j1j = (int)j1;
+
+			d[IX(i, j)] =
+				s0 * (t0 * d0[IX(i0i, j0i)] + t1 * d0[IX(i0i, j1j)]) +
+				s1 * (t0 * d0[IX(i1i, j0i)] + t1 * d0[IX(i1i, j1j)]);
+		}
+	}
+	set_bnd(b, d);
+}
+
+void UnmaskedFluidsim::diffuse(int b, float* x, float* x0, float diff, float dt) {
+	float a = dt * diff * N * N;
+	float w = 1.0f / (1 + 4 * a);
+
+	// left neighbour last, as in Fluidsim::diffuse
+	for (int k = 0; k < 20; k++) {
+		for (int j = 1; j <= N; j++) {
+			for (int i = 1; i <= N; i++) {
+				float rest = w * (x0[IX(i, j)] + a * x[IX(i + 1, j)] + a * (x[IX(i, j - 1)] + x[IX(i, j + 1)]));
+				x[IX(i, j)] = (w * a) * x[IX(i - 1, j)] + rest;
+			}
+		}
+		set_bnd(b, x);
+	}
+}
+
+void UnmaskedFluidsim::project(float* velocX, float* velocY, float* p, float* div) {
+	for (int j = 1; j <= N; j++) {
+		for (int i = 1; i <= N; i++) {
+			div[IX(i, j)] = -0.5f * ((velocX[IX(i + 1, j)] - velocX[IX(i - 1, j)]) + (velocY[IX(i, j + 1)] - velocY[IX(i, j - 1)])) / N;
+			p[IX(i, j)] = 0;
+		}
+	}
+	set_bnd(0, div);
+	set_bnd(0, p);
+
+	for (int k = 0; k < 20; k++) {
+		for (int j = 1; j <= N; j++) {
+			for (int i = 1; i <= N; i++) {
+				float rest = (div[IX(i, j)] + p[IX(i + 1, j)] + (p[IX(i, j - 1)] + p[IX(i, j + 1)])) * 0.25f;
+				p[IX(i, j)] = 0.25f * p[IX(i - 1, j)] + rest;
+			}
+		}
+		set_bnd(0, p);
+	}
+	for (int j = 1; j <= N; j++) {
+		for (int i = 1; i <= N; i++) {
+			velocX[IX(i, j)] -= 0.5f * (p[IX(i + 1, j)] - p[IX(i - 1, j)]) * N;
+			velocY[IX(i, j)] -= 0.5f * (p[IX(i, j + 1)] - p[IX(i, j - 1)]) * N;
+		}
+	}
+	set_bnd(1, velocX);
+	set_bnd(2, velocY);
+}
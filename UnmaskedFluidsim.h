@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+
+// The solver without obstacles: square grid, walls only at the outer box,
+// plain loops on one thread. --bench measures the masked kernels against it.
+// Its Gauss-Seidel sweeps add the left neighbour last, as Fluidsim's do, so
+// the comparison sees only the cost of the mask. It is frozen except for bug
+// fixes shared with the reference and changes to Fluidsim's loop order; add
+// no features or optimisations of its own.
+class UnmaskedFluidsim {
+public:
+	UnmaskedFluidsim(int N);
+
+	void step();
+	void addDensity(int x, int y, float amount);
+	void addVelocity(int x, int y, float amountX, float amountY);
+
+	float* getDensityArray() { return density.data(); }
+	float* getVelocityXArray() { return vx.data(); }
+	float* getVelocityYArray() { return vy.data(); }
+	int getWidth() const { return N; }
+	int getHeight() const { return N; }
+
+private:
+	int N;
+	float dt;
+	float diff;
+	float visc;
+
+	std::vector<float> s, density, vx, vy, vx0, vy0;
+
+	void diffuse(int b, float* x, float* x0, float diff, float dt);
+	void project(float* velocX, float* velocY, float* p, float* div);
+	void advect(int b, float* d, float* d0, float* velocX, float* velocY, float dt);
+	void set_bnd(int b, float* x);
+};
@@ -0,0 +1,263 @@
+#include "Validation.h"
+#include "Benchmark.h"
+#include "BenchmarkReport.h"
+#include "Fluidsim.h"
+#include "Obstacle.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static const double PI = 3.14159265358979;
+
+// Backtrace length in cells per step on every grid.
+static const double VALIDATION_CFL = 0.5;
+
+static const double TAYLOR_GREEN_SPEED = 1.0;
+static const double TAYLOR_GREEN_VISCOSITY = 0.01;
+static const double TAYLOR_GREEN_TIME = 1.0;
+
+// Re = lid speed * side / viscosity = 100; the flow is steady well before t = 15.
+static const double CAVITY_LID_SPEED = 1.0;
+static const double CAVITY_VISCOSITY = 0.01;
+static const double CAVITY_TIME = 15.0;
+
+// One revolution of a disc of radius 0.45 at one radian per unit time.
+static const double BLOB_OMEGA = 1.0;
+static const double BLOB_DISC_RADIUS = 0.45;
+static const double BLOB_OFFSET = 0.25;
+static const double BLOB_SIGMA = 0.08;
+
+// u on the vertical centreline of the Re = 100 cavity, Ghia, Ghia & Shin,
+// J. Comput. Phys. 48 (1982), table I; {y, u / lid speed}, walls left out.
+static const double GHIA_RE100_U[][2] = {
+	{ 0.9766, 0.84123 }, { 0.9688, 0.78871 }, { 0.9609, 0.73722 }, { 0.9531, 0.68717 },
+	{ 0.8516, 0.23151 }, { 0.7344, 0.00332 }, { 0.6172, -0.13641 }, { 0.5000, -0.20581 },
+	{ 0.4531, -0.21090 }, { 0.2813, -0.15662 }, { 0.1719, -0.10150 }, { 0.1016, -0.06434 },
+	{ 0.0703, -0.04775 }, { 0.0625, -0.04192 }, { 0.0547, -0.03717 }
+};
+
+struct ValidationResult {
+	double error;
+	double msPerStep;
+	int steps;
+};
+
+struct ValidationVariant {
+	const char* name;
+	SolverQuality quality;
+};
+
+// Steps with dt = VALIDATION_CFL cells at `speed` over `duration`, rounded
+// so the run ends exactly at `duration`.
+static int scenarioSteps(double duration, double speed, double h) {
+	return std::max(1, (int)std::ceil(duration * speed / (VALIDATION_CFL * h)));
+}
+
+static ValidationResult taylorGreen(int N, const SolverQuality& quality) {
+	Fluidsim sim(N);
+	double h = 1.0 / N;
+	int steps = scenarioSteps(TAYLOR_GREEN_TIME, TAYLOR_GREEN_SPEED, h);
+	sim.setQuality(quality);
+	sim.setViscosity((float)TAYLOR_GREEN_VISCOSITY);
+	sim.setTimeStep((float)(TAYLOR_GREEN_TIME / steps));
+
+	for (int j = 1; j <= N; j++) {
+		for (int i = 1; i <= N; i++) {
+			double x = (i - 0.5) * h, y = (j - 0.5) * h;
+			sim.addVelocity(i, j, (float)(TAYLOR_GREEN_SPEED * std::sin(PI * x) * std::cos(PI * y)),
+				(float)(-TAYLOR_GREEN_SPEED * std::cos(PI * x) * std::sin(PI * y)));
+		}
+	}
+
+	double totalMs = 0.0;
+	for (int s = 0; s < steps; s++) {
+		sim.step();
+		totalMs += sim.getLastFrameMs();
+	}
+
+	double decay = std::exp(-2.0 * PI * PI * TAYLOR_GREEN_VISCOSITY * TAYLOR_GREEN_TIME);
+	const float* vx = sim.getVelocityXArray();
+	const float* vy = sim.getVelocityYArray();
+	double errorSq = 0.0, exactSq = 0.0;
+	for (int j = 1; j <= N; j++) {
+		for (int i = 1; i <= N; i++) {
+			double x = (i - 0.5) * h, y = (j - 0.5) * h;
+			double u = TAYLOR_GREEN_SPEED * decay * std::sin(PI * x) * std::cos(PI * y);
+			double v = -TAYLOR_GREEN_SPEED * decay * std::cos(PI * x) * std::sin(PI * y);
+			int idx = i + j * (N + 2);
+			errorSq += (vx[idx] - u) * (vx[idx] - u) + (vy[idx] - v) * (vy[idx] - v);
+			exactSq += u * u + v * v;
+		}
+	}
+	ValidationResult r = { std::sqrt(errorSq / exactSq), totalMs / steps, steps };
+	return r;
+}
+
+// The unit cavity is N x N cells inside a one-cell frame of solids; the top
+// row of the frame is a box obstacle moving at the lid speed without moving.
+static ValidationResult lidCavity(int N, const SolverQuality& quality) {
+	int M = N + 2;
+	double h = 1.0 / N;
+	int steps = scenarioSteps(CAVITY_TIME, CAVITY_LID_SPEED, h);
+
+	MovingObstacle lid = MovingObstacle::box(0.5f * N - 0.25f, 0.25f);
+	lid.setPose(0.5f * (N + 3), (float)M, 0.0f);
+	lid.setVelocity((float)(CAVITY_LID_SPEED / h), 0.0f, 0.0f);
+
+	Fluidsim sim(M, M, (float)h, (float)h);
+	sim.setQuality(quality);
+	sim.setViscosity((float)CAVITY_VISCOSITY);
+	sim.setTimeStep((float)(CAVITY_TIME / steps));
+	sim.addObstacleRect(1, 1, M, 1);
+	sim.addObstacleRect(1, 1, 1, M);
+	sim.addObstacleRect(M, 1, M, M);
+	sim.addMovingObstacle(&lid);
+
+	double totalMs = 0.0;
+	for (int s = 0; s < steps; s++) {
+		sim.step();
+		totalMs += sim.getLastFrameMs();
+	}
+
+	// u at x = 0.5 (between the two middle columns) on the cell centres
+	// y = (j - 0.5) h, with the wall speeds at y = 0 and y = 1 at the ends.
+	const float* vx = sim.getVelocityXArray();
+	std::vector<double> ys(N + 2), profile(N + 2);
+	ys[0] = 0.0;
+	profile[0] = 0.0;
+	ys[N + 1] = 1.0;
+	profile[N + 1] = CAVITY_LID_SPEED;
+	for (int j = 1; j <= N; j++) {
+		int row = (j + 1) * (M + 2);
+		ys[j] = (j - 0.5) * h;
+		profile[j] = 0.5 * (vx[row + N / 2 + 1] + vx[row + N / 2 + 2]);
+	}
+
+	double errorSq = 0.0;
+	int points = sizeof(GHIA_RE100_U) / sizeof(GHIA_RE100_U[0]);
+	for (int k = 0; k < points; k++) {
+		double y = GHIA_RE100_U[k][0];
+		int j = (int)(std::upper_bound(ys.begin(), ys.end(), y) - ys.begin()) - 1;
+		double t = (y - ys[j]) / (ys[j + 1] - ys[j]);
+		double u = (1.0 - t) * profile[j] + t * profile[j + 1];
+		double d = u / CAVITY_LID_SPEED - GHIA_RE100_U[k][1];
+		errorSq += d * d;
+	}
+	ValidationResult r = { std::sqrt(errorSq / points), totalMs / steps, steps };
+	return r;
+}
+
+// Rotation about the domain centre inside the disc, at rest outside it.
+static void setRotation(Fluidsim& sim, int N) {
+	double h = 1.0 / N;
+	const float* vx = sim.getVelocityXArray();
+	const float* vy = sim.getVelocityYArray();
+	for (int j = 1; j <= N; j++) {
+		for (int i = 1; i <= N; i++) {
+			double x = (i - 0.5) * h - 0.5, y = (j - 0.5) * h - 0.5;
+			bool inside = x * x + y * y < BLOB_DISC_RADIUS * BLOB_DISC_RADIUS;
+			double u = inside ? -BLOB_OMEGA * y : 0.0;
+			double v = inside ? BLOB_OMEGA * x : 0.0;
+			int idx = i + j * (N + 2);
+			sim.addVelocity(i, j, (float)(u - vx[idx]), (float)(v - vy[idx]));
+		}
+	}
+}
+
+static ValidationResult rotatingBlob(int N, const SolverQuality& quality) {
+	Fluidsim sim(N);
+	double h = 1.0 / N;
+	double period = 2.0 * PI / BLOB_OMEGA;
+	int steps = scenarioSteps(period, BLOB_OMEGA * BLOB_DISC_RADIUS, h);
+	sim.setQuality(quality);
+	sim.setTimeStep((float)(period / steps));
+
+	std::vector<double> initial((N + 2) * (N + 2), 0.0);
+	for (int j = 1; j <= N; j++) {
+		for (int i = 1; i <= N; i++) {
+			double x = (i - 0.5) * h - (0.5 + BLOB_OFFSET), y = (j - 0.5) * h - 0.5;
+			double d = std::exp(-(x * x + y * y) / (2.0 * BLOB_SIGMA * BLOB_SIGMA));
+			initial[i + j * (N + 2)] = d;
+			sim.addDensity(i, j, (float)d);
+		}
+	}
+
+	double totalMs = 0.0;
+	for (int s = 0; s < steps; s++) {
+		setRotation(sim, N);
+		sim.step();
+		totalMs += sim.getLastFrameMs();
+	}
+
+	// step() multiplies density by 0.995 every nominal step
+	double decay = std::pow(0.995, steps);
+	const float* density = sim.getDensityArray();
+	double error = 0.0, exact = 0.0;
+	for (int j = 1; j <= N; j++) {
+		for (int i = 1; i <= N; i++) {
+			int idx = i + j * (N + 2);
+			error += std::fabs(density[idx] - decay * initial[idx]);
+			exact += decay * initial[idx];
+		}
+	}
+	ValidationResult r = { error / exact, totalMs / steps, steps };
+	return r;
+}
+
+void runValidationSuite(int N, BenchmarkReport& report) {
+	typedef ValidationResult (*Scenario)(int, const SolverQuality&);
+	struct NamedScenario {
+		const char* name;
+		Scenario run;
+	};
+	const NamedScenario scenarios[] = {
+		{ "taylor_green", taylorGreen },
+		{ "lid_cavity", lidCavity },
+		{ "rotating_blob", rotatingBlob }
+	};
+	const ValidationVariant variants[] = {
+		{ "full", { 20, 20, true, true } },
+		{ "reduced", { 6, 8, true, true } }
+	};
+	int sizes[] = { N / 2, N };
+
+	std::cout << "validation scenarios (variant, steps, ms/step, error):" << std::endl;
+	for (const NamedScenario& scenario : scenarios) {
+		std::cout << "  " << scenario.name << ":" << std::endl;
+		for (int n : sizes) {
+			for (const ValidationVariant& variant : variants) {
+				ValidationResult r = scenario.run(n, variant.quality);
+				std::string label = variant.name + std::string(" ") + std::to_string(n) + "^2";
+				std::cout << "    " << std::left << std::setw(14) << label << std::right << std::setw(6) << r.steps
+					<< std::setw(10) << r.msPerStep << std::setw(12) << r.error << std::endl;
+
+				std::string prefix = std::string("validation.") + scenario.name + "." + variant.name + ".n" + std::to_string(n);
+				report.setMetric(prefix + ".error", r.error);
+				report.setMetric(prefix + ".step_ms", r.msPerStep);
+			}
+		}
+	}
+}
+
+int runValidation(int argc, char** argv) {
+	BenchmarkOptions options(64, 1);
+	if (!parseBenchmarkOptions(argc, argv, options)) return 1;
+	// even, so both grids have a centre line between two columns
+	int N = std::min(options.N, 512) / 4 * 4;
+
+	BenchmarkReport report;
+	report.setInfo("n", N);
+	runValidationSuite(N, report);
+
+	if (options.jsonPath != nullptr) {
+		if (!report.write(options.jsonPath)) {
+			std::cerr << "could not write " << options.jsonPath << std::endl;
+			return 1;
+		}
+		std::cout << "results written to " << options.jsonPath << std::endl;
+	}
+	return 0;
+}
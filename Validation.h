@@ -0,0 +1,29 @@
+#pragma once
+
+class BenchmarkReport;
+
+// `--validate [N] [--json <path>]`: standard scenarios with a known answer,
+// run for several solver variants so accuracy can be weighed against cost.
+//
+//  - taylor_green: one Taylor-Green vortex cell filling the box. Its
+//    velocity has no normal component and no shear at the walls, so the
+//    free-slip walls of set_bnd act as the periodic images would, and the
+//    exact solution is the initial field decaying as exp(-2 pi^2 nu t).
+//    Error: L2 norm of the velocity error relative to the exact field.
+//  - lid_cavity: the lid-driven cavity at Re = 100 inside a frame of
+//    obstacle cells, the lid being a moving obstacle. Error: RMS difference
+//    of the steady u profile on the vertical centreline from the tabulated
+//    values of Ghia, Ghia & Shin (1982), in lid velocities.
+//  - rotating_blob: a Gaussian density blob carried once around the centre
+//    by solid-body rotation, the velocity being reset before every step.
+//    Error: L1 norm of the density error relative to the initial blob
+//    (times the solver's built-in density decay over the run).
+//
+// Variants are N/2 and N (default 64) at the full and a reduced solver
+// quality. Every scenario runs for a fixed physical time with dt
+// proportional to the cell size, so the CFL number is the same on each grid.
+int runValidation(int argc, char** argv);
+
+// The table printed by --validate, also run by --bench. Adds
+// "validation.<scenario>.<variant>.n<size>.error" and ".step_ms" metrics.
+void runValidationSuite(int N, BenchmarkReport& report);
@@ -1,4 +1,7 @@
 #include <iostream>
+#include <cstring>
+#include <string>
+#include <vector>
 
 // --- CHANGED ---
 #define GLEW_STATIC 
@@ -7,21 +10,61 @@
 
 #include "FluidSim.h"
 #include "Renderer.h"
+#include "Benchmark.h"
+#include "Roofline.h"
+#include "Scaling.h"
+#include "RegressionGate.h"
+#include "SelfTest.h"
+#include "Validation.h"
+#include "StateDigest.h"
+#include "SimulationThread.h"
+#include "ResolutionGovernor.h"
+#include "QualityGovernor.h"
+#include "Profiler.h"
 
 const int SCREEN_WIDTH = 800;
 const int SCREEN_HEIGHT = 800;
-const int GRID_SIZE = 128;
+const int GRID_WIDTH = 128;
+const int GRID_HEIGHT = GRID_WIDTH * SCREEN_HEIGHT / SCREEN_WIDTH;
+const float SIM_STEPS_PER_SECOND = 60.0f;
+// density is carried on a grid this many times finer than the velocity
+const int DENSITY_RESOLUTION = 2;
+// Each step is kept inside this budget, first by lowering solver iterations,
+// then by resizing the grid from GRID_WIDTH. Input stays in GRID_WIDTH x
+// GRID_HEIGHT cells.
+const float STEP_BUDGET_MS = 8.0f;
+const int MIN_GRID_WIDTH = 64;
+const int MAX_GRID_WIDTH = 512;
+const float BRUSH_RADIUS = 3.0f;
+const float BRUSH_SPACING = 0.5f;
+// written on exit when the profiler was switched on (P) during the run
+const char* TRACE_PATH = "fluidsim_trace.json";
 
 bool mouseIsDown = false;
+bool paddleIsDown = false;
+bool showActiveTiles = false;
+bool showProfiler = false;
+bool profilerUsed = false;
+float paddleX = 0.0f;
+float paddleY = 0.0f;
 double lastMouseX = 0;
 double lastMouseY = 0;
 Fluidsim* g_fluid_Sim = nullptr; 
+MovingObstacle g_paddle = MovingObstacle::box(1.5f, 8.0f);
 
 
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
         glfwSetWindowShouldClose(window, GLFW_TRUE);
     }
+    if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+        showActiveTiles = !showActiveTiles;
+    }
+    if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+        showProfiler = !showProfiler;
+        profilerUsed = profilerUsed || showProfiler;
+        Profiler::setEnabled(showProfiler);
+    }
 }
 
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
@@ -33,6 +76,32 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
             mouseIsDown = false;
         }
     }
+    if (button == GLFW_MOUSE_BUTTON_RIGHT && g_fluid_Sim != nullptr) {
+        if (action == GLFW_PRESS) {
+            paddleX = (float)(lastMouseX / SCREEN_WIDTH * GRID_WIDTH);
+            paddleY = (float)(lastMouseY / SCREEN_HEIGHT * GRID_HEIGHT);
+
+            InputCommand pose = {};
+            pose.type = InputCommand::OBSTACLE_POSE;
+            pose.obstacle = &g_paddle;
+            pose.posX = paddleX;
+            pose.posY = paddleY;
+            g_fluid_Sim->submit(pose);
+
+            InputCommand add = {};
+            add.type = InputCommand::OBSTACLE_ADD;
+            add.obstacle = &g_paddle;
+            g_fluid_Sim->submit(add);
+            paddleIsDown = true;
+        }
+        else if (action == GLFW_RELEASE) {
+            InputCommand remove = {};
+            remove.type = InputCommand::OBSTACLE_REMOVE;
+            remove.obstacle = &g_paddle;
+            g_fluid_Sim->submit(remove);
+            paddleIsDown = false;
+        }
+    }
 }
 
 void cursor_position_callback(GLFWwindow* window, double xpos, double ypos) {
@@ -40,17 +109,70 @@ void cursor_position_callback(GLFWwindow* window, double xpos, double ypos) {
         float velX = (float)(xpos - lastMouseX);
         float velY = (float)(ypos - lastMouseY);
 
-        int gridX = (int)((xpos / SCREEN_WIDTH) * GRID_SIZE);
-        int gridY = (int)((ypos / SCREEN_HEIGHT) * GRID_SIZE);
+        Splat from = { (float)(lastMouseX / SCREEN_WIDTH * GRID_WIDTH), (float)(lastMouseY / SCREEN_HEIGHT * GRID_HEIGHT), BRUSH_RADIUS, 0.0f, velX, velY };
+        Splat to = { (float)(xpos / SCREEN_WIDTH * GRID_WIDTH), (float)(ypos / SCREEN_HEIGHT * GRID_HEIGHT), BRUSH_RADIUS, 500.0f, velX, velY };
 
-        g_fluid_Sim->addDensity(gridX, gridY, 500.0f);
-        g_fluid_Sim->addVelocity(gridX, gridY, velX, velY);
+        std::vector<Splat> stroke;
+        interpolateStroke(from, to, BRUSH_SPACING, stroke);
+        for (size_t k = 0; k < stroke.size(); k++) {
+            InputCommand dab = {};
+            dab.type = InputCommand::GAUSSIAN_SPLAT;
+            dab.posX = stroke[k].x;
+            dab.posY = stroke[k].y;
+            dab.radius = stroke[k].radius;
+            dab.density = stroke[k].density;
+            dab.vx = stroke[k].vx;
+            dab.vy = stroke[k].vy;
+            g_fluid_Sim->submit(dab);
+        }
+    }
+    if (paddleIsDown && g_fluid_Sim != nullptr) {
+        float cellX = (float)(xpos / SCREEN_WIDTH * GRID_WIDTH);
+        float cellY = (float)(ypos / SCREEN_HEIGHT * GRID_HEIGHT);
+        float stepsPerMove = 1.0f / g_fluid_Sim->getTimeStep();
+
+        InputCommand pose = {};
+        pose.type = InputCommand::OBSTACLE_POSE;
+        pose.obstacle = &g_paddle;
+        pose.posX = cellX;
+        pose.posY = cellY;
+        pose.vx = (cellX - paddleX) * stepsPerMove;
+        pose.vy = (cellY - paddleY) * stepsPerMove;
+        g_fluid_Sim->submit(pose);
+
+        paddleX = cellX;
+        paddleY = cellY;
     }
     lastMouseX = xpos;
     lastMouseY = ypos;
 }
 
-int main() {    
+int main(int argc, char** argv) {    
+    if (argc > 1 && std::strcmp(argv[1], "--bench") == 0) {
+        return runBenchmark(argc, argv);
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--roofline") == 0) {
+        return runRoofline(argc, argv);
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--scaling") == 0) {
+        return runScaling(argc, argv);
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--gate") == 0) {
+        return runRegressionGate(argc, argv);
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--selftest") == 0) {
+        return runSelfTest(argc, argv);
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--validate") == 0) {
+        return runValidation(argc, argv);
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--digest") == 0) {
+        return runDigest(argc, argv);
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--digest-compare") == 0) {
+        return runDigestCompare(argc, argv);
+    }
+
     if (!glfwInit()) {
         std::cerr << "Failed to initialize GLFW" << std::endl;
         return -1;
@@ -117,10 +239,24 @@ int main() {
     glDisable(GL_BLEND);
 
 
-    Fluidsim fluidSim(GRID_SIZE);
+    Fluidsim fluidSim(GRID_WIDTH, GRID_HEIGHT);
+    if (!fluidSim.setDensityResolution(DENSITY_RESOLUTION)) {
+        std::cerr << "Density resolution must be 1, 2 or 4" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
     g_fluid_Sim = &fluidSim;
 
-    Renderer renderer(SCREEN_WIDTH, SCREEN_HEIGHT, GRID_SIZE);
+    Renderer renderer(SCREEN_WIDTH, SCREEN_HEIGHT, GRID_WIDTH, GRID_HEIGHT, DENSITY_RESOLUTION);
+
+    ResolutionGovernor governor(GRID_WIDTH, GRID_HEIGHT, STEP_BUDGET_MS);
+    governor.setLimits(MIN_GRID_WIDTH, MAX_GRID_WIDTH);
+
+    QualityGovernor quality(STEP_BUDGET_MS);
+
+    SimulationThread simThread(&fluidSim, SIM_STEPS_PER_SECOND);
+    simThread.setResolutionGovernor(&governor);
+    simThread.setQualityGovernor(&quality);
 
 
     glfwSetKeyCallback(window, key_callback);
@@ -129,20 +265,52 @@ int main() {
 
 
     
+    Profiler::setThreadName("render");
+    simThread.start();
+
+    std::vector<ProfileAverage> stageAverages;
+    double lastTitleTime = glfwGetTime();
+    int renderedFrames = 0;
     while (!glfwWindowShouldClose(window)) {
         glfwPollEvents();
-        fluidSim.step();
+
+        double now = glfwGetTime();
+        if (now - lastTitleTime > 0.5) {
+            InputQueueStats inputStats = fluidSim.getInputStats();
+            std::string title = "Simple CPU Fluid Sim (GLEW) - sim " + std::to_string((int)simThread.getStepsPerSecond())
+                + " steps/s (" + std::to_string(simThread.getLastStepMs()) + " ms), render "
+                + std::to_string((int)(renderedFrames / (now - lastTitleTime))) + " fps, grid "
+                + std::to_string(renderer.getGridWidth()) + "x" + std::to_string(renderer.getGridHeight()) + ", input queue "
+                + std::to_string(inputStats.depth) + " (" + std::to_string(inputStats.dropped) + " dropped)";
+            glfwSetWindowTitle(window, title.c_str());
+            lastTitleTime = now;
+            renderedFrames = 0;
+        }
 
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
         glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
         glClearColor(0.2f, 0.3f, 0.8f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
-        renderer.draw(fluidSim.getDensityArray());
+        const SimFrame& frame = simThread.frames().acquire();
+        if (frame.stepIndex >= 0) {
+            renderer.resize(frame.width, frame.height);
+            renderer.setTileOverlay(showActiveTiles ? frame.activeTiles.data() : nullptr, frame.tilesX, frame.tilesY, Fluidsim::TILE_SIZE);
+            renderer.draw(frame.density.data(), frame.fluidMask.data());
+        }
+        if (showProfiler) {
+            Profiler::getAverages(stageAverages);
+            renderer.drawHud(stageAverages);
+        }
 
         glfwSwapBuffers(window);
+        renderedFrames++;
     }
    
+    simThread.stop();
+    if (profilerUsed && Profiler::writeChromeTrace(TRACE_PATH)) {
+        std::cout << "Profile trace written to " << TRACE_PATH << std::endl;
+    }
     glfwTerminate();
     return 0;
 }